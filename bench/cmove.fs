@@ -0,0 +1,8 @@
+\ expect: 7
+\ CMOVE throughput, 64KB two hundred times
+: src scratch ;
+: dst scratch 65536 + ;
+: copies BEGIN src dst 65536 CMOVE 1- DUP 0= UNTIL DROP ;
+7 src 65535 + C!
+200 copies
+dst 65535 + C@ .
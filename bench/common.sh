@@ -0,0 +1,60 @@
+# Shared by run.sh and vs-jonesforth.sh, which source it.
+
+# generate_inputs <dir>: write the generated benchmarks, find.fs and compile.fs
+#   FIND over a large dictionary: define WORDS words, then look them up LOOKUPS times
+#   compile throughput: DEFINITIONS definitions, each calling an earlier one
+generate_inputs() {
+    awk -v words="${WORDS:-20000}" -v lookups="${LOOKUPS:-1000000}" 'BEGIN {
+        print "\\ expect: 42"
+        for (i = 0; i < words; i += 10) {
+            line = ""
+            for (j = i; j < i + 10 && j < words; j++) line = line ": w" j " ; "
+            print line
+        }
+        srand(1)
+        for (i = 0; i < lookups; i += 10) {
+            line = ""
+            for (j = 0; j < 10; j++) line = line "w" int(rand() * words) " "
+            print line
+        }
+        print "42 ."
+    }' > "$1/find.fs"
+
+    awk -v definitions="${DEFINITIONS:-50000}" 'BEGIN {
+        print "\\ expect: 42"
+        print ": c0 DUP 1+ ;"
+        srand(2)
+        for (i = 1; i < definitions; i++) {
+            print ": c" i " DUP 1+ SWAP OVER + " i " * DROP c" int(rand() * i) " 2 - IF 1 ELSE 0 THEN ;"
+        }
+        print "42 ."
+    }' > "$1/compile.fs"
+}
+
+# best_ns <runs> <binary> <input> <output>: fastest of <runs> runs, in nanoseconds
+best_ns() {
+    best=
+    i=0
+    while [ $i -lt "$1" ]; do
+        start=$(date +%s%N)
+        "$2" < "$3" > "$4"
+        end=$(date +%s%N)
+        t=$((end - start))
+        if [ -z "$best" ] || [ $t -lt "$best" ]; then best=$t; fi
+        i=$((i + 1))
+    done
+    echo "$best"
+}
+
+# output_ok <source> <output>: did it print the number on the "\ expect:" line,
+# and find every word?
+output_ok() {
+    expect=$(sed -n 's/^\\ expect: *//p' "$1")
+    if grep -qw -- "$expect" "$2" && ! grep -q "Unknown word\|PARSE ERROR" "$2"; then
+        echo true
+    else
+        echo false
+    fi
+}
+
+BENCHMARKS="fib sieve loops cmove find compile"
@@ -0,0 +1,4 @@
+\ expect: 2178309
+\ recursive calls and returns
+: fib DUP 2 < IF EXIT THEN DUP 1- RECURSE SWAP 2 - RECURSE + ;
+32 fib .
@@ -0,0 +1,82 @@
+// FIND lookup cost as the dictionary grows, hashed lookup vs the old linear walk.
+//
+// build and run from the top of the repo:
+//   gcc -O2 -DDEBUG=0 bench/find_bench.c -o find_bench && ./find_bench
+//
+// riversforth.c is a single file with its own main(), so pull it in with that
+// renamed and drive add_word() / do_find() directly.
+#define main riversforth_main
+#include "../riversforth.c"
+#undef main
+
+#include <time.h>
+
+#define LOOKUPS 1000000
+
+double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+Word *linear_find(const char *name, size_t length) {
+    // what do_find used to do
+    for (Word *w = latest; w != NULL; w = w->link) {
+        if (strncasecmp(w->name, name, length) == 0 && w->name[length] == '\0'
+                && !(w->flags & F_HIDDEN)) {
+            return w;
+        }
+    }
+    return NULL;
+}
+
+int main(void) {
+    static const int sizes[] = { 50, 500, 5000, 50000 };
+    int defined = 0;
+    char name[32];
+
+    stacks_init();
+    printf("%8s %14s %14s\n", "words", "hashed ns/op", "linear ns/op");
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        while (defined < sizes[i]) {
+            Word *w = calloc(1, sizeof(Word));
+            snprintf(name, sizeof(name), "word%d", defined++);
+            w->name = strdup(name);
+            w->code = do_drop;
+            add_word(w);
+        }
+
+        // look up a spread of existing names plus a miss now and then,
+        // in upper case to include the case folding
+        unsigned seed = 12345;
+        Cell found = 0;
+        double start = now();
+        for (int n = 0; n < LOOKUPS; n++) {
+            seed = seed * 1103515245 + 12345;
+            int len = (n & 15) ? snprintf(name, sizeof(name), "WORD%u", seed % defined)
+                               : snprintf(name, sizeof(name), "MISSING%u", seed % defined);
+            push((Cell)name);
+            push(len);
+            do_find();
+            found += pop() != 0;
+        }
+        double hashed = (now() - start) * 1e9 / LOOKUPS;
+
+        int linear_lookups = LOOKUPS / (defined / 50); // keep the slow one bearable
+        seed = 12345;
+        start = now();
+        for (int n = 0; n < linear_lookups; n++) {
+            seed = seed * 1103515245 + 12345;
+            int len = (n & 15) ? snprintf(name, sizeof(name), "WORD%u", seed % defined)
+                               : snprintf(name, sizeof(name), "MISSING%u", seed % defined);
+            found += linear_find(name, len) != NULL;
+        }
+        double linear = (now() - start) * 1e9 / linear_lookups;
+
+        printf("%8d %14.1f %14.1f\n", defined, hashed, linear);
+        if (found == 0) {
+            return 1; // keep the compiler from throwing the lookups away
+        }
+    }
+    return 0;
+}
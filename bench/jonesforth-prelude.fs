@@ -0,0 +1,7 @@
+\ Loaded after jonesforth.f ahead of every benchmark by vs-jonesforth.sh, to
+\ give the benchmarks what bench/prelude.fs gives them in riversforth.
+\ jonesforth.f has the control structures and RECURSE, CMOVE is built in.
+\ JonesForth's data segment doesn't grow by itself, the scratch memory and the
+\ big generated benchmarks need about 8MB.
+2097152 MORECORE
+: scratch HERE @ 4096 + ;
@@ -0,0 +1,4 @@
+\ expect: 5000000
+\ nested BEGIN UNTIL loops, counting the inner iterations
+: loops 0 SWAP BEGIN 1000 BEGIN ROT 1+ -ROT 1- DUP 0= UNTIL DROP 1- DUP 0= UNTIL DROP ;
+5000 loops .
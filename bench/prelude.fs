@@ -0,0 +1,14 @@
+\ Loaded ahead of every benchmark by run.sh.
+\ JonesForth's control structures, with branch offsets counted in cells.
+: RECURSE IMMEDIATE LATEST @ , ;
+: IF IMMEDIATE ' 0BRANCH , HERE @ 0 , ;
+: THEN IMMEDIATE DUP HERE @ SWAP - 8 / SWAP ! ;
+: ELSE IMMEDIATE ' BRANCH , HERE @ 0 , SWAP DUP HERE @ SWAP - 8 / SWAP ! ;
+: BEGIN IMMEDIATE HERE @ ;
+: UNTIL IMMEDIATE ' 0BRANCH , HERE @ - 8 / , ;
+: AGAIN IMMEDIATE ' BRANCH , HERE @ - 8 / , ;
+: WHILE IMMEDIATE ' 0BRANCH , HERE @ 0 , ;
+: REPEAT IMMEDIATE ' BRANCH , SWAP HERE @ - 8 / , DUP HERE @ SWAP - 8 / SWAP ! ;
+\ scratch memory for the benchmarks' arrays, 2MB of the data space
+VARIABLE scratch-area 2097152 ALLOT scratch-area !
+: scratch scratch-area @ ;
@@ -0,0 +1,45 @@
+#!/bin/sh
+# Runs each benchmark and prints the results as JSON on stdout.
+#
+#   bench/run.sh <riversforth> <riversforth built with STATS=2>
+#
+# "make bench" builds both and runs this. Every benchmark is bench/prelude.fs
+# followed by its .fs file, piped into the interpreter. wall_seconds is the best
+# of RUNS runs (default 3) of the first binary; dispatched is how many words the
+# second one's inner interpreter ran for the same input (from its
+# RIVERSFORTH_STATS report), so dispatched_per_second is a rate for the first
+# binary. Words run as native code (JIT=1) aren't dispatched and don't count.
+# ok is false if the output doesn't have the number on the benchmark's
+# "\ expect:" line, or something wasn't found.
+
+set -e
+bin=${1:-bench/riversforth}
+count_bin=${2:-bench/riversforth-count}
+runs=${RUNS:-3}
+dir=$(dirname "$0")
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+. "$dir/common.sh"
+generate_inputs "$work"
+
+first=1
+printf '{\n  "flags": "%s",\n  "runs": %d,\n  "benchmarks": [\n' "$FLAGS" "$runs"
+for name in $BENCHMARKS; do
+    src="$dir/$name.fs"
+    [ -f "$src" ] || src="$work/$name.fs"
+    cat "$dir/prelude.fs" "$src" > "$work/input.fs"
+    best=$(best_ns "$runs" "$bin" "$work/input.fs" "$work/output.txt")
+    ok=$(output_ok "$src" "$work/output.txt")
+    RIVERSFORTH_STATS="$work/stats.json" "$count_bin" < "$work/input.fs" > /dev/null
+    dispatched=$(sed -n 's/^ *"dispatched": *\([0-9]*\).*/\1/p' "$work/stats.json")
+
+    [ $first = 1 ] || printf ',\n'
+    first=0
+    awk -v name="$name" -v ok="$ok" -v ns="$best" -v n="${dispatched:-0}" 'BEGIN {
+        s = ns / 1e9
+        printf "    {\"name\": \"%s\", \"ok\": %s, \"wall_seconds\": %.6f, \"dispatched\": %d, \"dispatched_per_second\": %.0f}",
+            name, ok, s, n, (s > 0 ? n / s : 0)
+    }'
+done
+printf '\n  ]\n}\n'
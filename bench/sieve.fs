@@ -0,0 +1,9 @@
+\ expect: 78498
+\ byte array loads and stores, the number of primes below a million, four times
+: limit scratch ;
+: flags scratch 8 + ;
+: clear BEGIN 1- 1 OVER flags + C! DUP 0= UNTIL DROP ;
+: mark DUP DUP * BEGIN DUP limit @ < WHILE 0 OVER flags + C! OVER + REPEAT 2DROP ;
+: sieve DUP limit ! clear 0 2 BEGIN DUP limit @ < WHILE DUP flags + C@ IF SWAP 1+ SWAP DUP mark THEN 1+ REPEAT DROP ;
+: sieves BEGIN 1000000 sieve DROP 1- DUP 0= UNTIL DROP ;
+3 sieves 1000000 sieve .
@@ -0,0 +1,55 @@
+#!/bin/sh
+# Runs the benchmarks on riversforth and on jonesforth.S and prints the times
+# as JSON on stdout, with ratio = riversforth time / jonesforth time.
+#
+#   bench/vs-jonesforth.sh <riversforth> <jonesforth>
+#
+# "make bench-jonesforth" builds both and runs this. jonesforth is i386 code, so
+# building it needs a 32 bit toolchain (gcc -m32 and 32 bit kernel headers),
+# and its -Ttext,0 link means running it needs vm.mmap_min_addr set to 0.
+# riversforth gets bench/prelude.fs ahead of each benchmark, jonesforth gets
+# jonesforth.f and bench/jonesforth-prelude.fs.
+# JonesForth's FIND walks the whole dictionary, so the find and compile
+# benchmarks are smaller here: 5000 words looked up 100000 times and 5000
+# definitions (WORDS, LOOKUPS and DEFINITIONS change them).
+
+set -e
+rivers=${1:-bench/riversforth}
+jones=${2:-bench/jonesforth}
+runs=${RUNS:-3}
+dir=$(dirname "$0")
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+. "$dir/common.sh"
+WORDS=${WORDS:-5000}
+LOOKUPS=${LOOKUPS:-100000}
+DEFINITIONS=${DEFINITIONS:-5000}
+generate_inputs "$work"
+
+# check jonesforth runs at all before timing anything
+if ! echo "1 2 + ." | cat "$dir/../jonesforth.f" - | "$jones" 2>/dev/null | grep -qw 3; then
+    echo "$jones doesn't run, see the top of $0" >&2
+    exit 1
+fi
+
+first=1
+printf '{\n  "flags": "%s",\n  "runs": %d,\n  "benchmarks": [\n' "$FLAGS" "$runs"
+for name in $BENCHMARKS; do
+    src="$dir/$name.fs"
+    [ -f "$src" ] || src="$work/$name.fs"
+    cat "$dir/prelude.fs" "$src" > "$work/rivers.fs"
+    cat "$dir/../jonesforth.f" "$dir/jonesforth-prelude.fs" "$src" > "$work/jones.fs"
+    rivers_ns=$(best_ns "$runs" "$rivers" "$work/rivers.fs" "$work/rivers.txt")
+    rivers_ok=$(output_ok "$src" "$work/rivers.txt")
+    jones_ns=$(best_ns "$runs" "$jones" "$work/jones.fs" "$work/jones.txt")
+    jones_ok=$(output_ok "$src" "$work/jones.txt")
+
+    [ $first = 1 ] || printf ',\n'
+    first=0
+    awk -v name="$name" -v rok="$rivers_ok" -v jok="$jones_ok" -v r="$rivers_ns" -v j="$jones_ns" 'BEGIN {
+        printf "    {\"name\": \"%s\", \"ok\": %s, \"riversforth_seconds\": %.6f, \"jonesforth_seconds\": %.6f, \"ratio\": %.3f}",
+            name, (rok == "true" && jok == "true") ? "true" : "false", r / 1e9, j / 1e9, (j > 0 ? r / j : 0)
+    }'
+done
+printf '\n  ]\n}\n'
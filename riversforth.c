@@ -4,9 +4,126 @@
 #include <ctype.h>
 #include <stdlib.h>
 #include <assert.h>
+#include <setjmp.h>
+#include <signal.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <stdarg.h>
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#endif
+#include <sys/mman.h>
 
 #define VERSION 1
+#ifndef DEBUG
 #define DEBUG 1
+#endif
+
+// Inner interpreter selection.
+// 0 = run() fetches each Word and calls its code function (portable C).
+// 1 = run() is a direct-threaded loop using GCC/Clang labels-as-values
+//     ("computed goto"), with the common primitives copied inline into it.
+#ifndef THREADED_GOTO
+#define THREADED_GOTO 0
+#endif
+
+// 1 = the goto version of run() keeps the top of the data stack in a local
+// (tos) instead of in data_stack. Only makes sense with THREADED_GOTO since the
+// portable run() has no loop-local state to keep it in.
+#ifndef TOS_CACHE
+#define TOS_CACHE 0
+#endif
+#if TOS_CACHE && !THREADED_GOTO
+#error "TOS_CACHE needs THREADED_GOTO"
+#endif
+
+// do_interpret copies the body of a colon word into the word being compiled,
+// instead of compiling a call to it, if the body is at most this many cells
+// (not counting EXIT). 0 = only inline words marked INLINE.
+#ifndef INLINE_LIMIT
+#define INLINE_LIMIT 4
+#endif
+
+// 1 = ; also translates the new word into x86-64 machine code (Linux only)
+// by pasting together a machine code template for each word in its body
+#ifndef JIT
+#define JIT 0
+#endif
+#if JIT && !(defined(__x86_64__) && defined(__linux__))
+#error "JIT only knows how to generate x86-64 code for Linux"
+#endif
+
+// 1 = do_interpret works out arithmetic on literals (2 3 + ...) while compiling
+// and compiles just the answer
+#ifndef CONST_FOLD
+#define CONST_FOLD 1
+#endif
+
+// 1 = ; runs a peephole pass over the new word's body that fuses common
+// sequences (LIT n +, DUP +, < 0BRANCH, ...) into single superinstructions
+#ifndef PEEPHOLE
+#define PEEPHOLE 1
+#endif
+
+// 1 = ; also turns a call to a colon word followed by EXIT into a TAILCALL,
+// which jumps to the word without pushing a return address
+#ifndef TAIL_CALLS
+#define TAIL_CALLS 1
+#endif
+
+// 1 = keep the counters STATS prints (docol entries, FIND lookups, ...), which
+// are single increments well away from the inner loop, cheap enough to leave on.
+// 2 = also count every word run() dispatches. That's an extra add in the
+// tightest loop there is, about 20% on the goto version of run().
+#ifndef STATS
+#define STATS 1
+#endif
+
+// 1 = count and time every word run() and do_interpret run, see PROFILE-REPORT.
+// Only the portable run(), the goto version doesn't go through docol and EXIT.
+#ifndef PROFILE
+#define PROFILE 0
+#endif
+#if PROFILE && THREADED_GOTO
+#error "PROFILE needs the portable run(), build without THREADED_GOTO"
+#endif
+#if PROFILE && JIT
+#error "PROFILE can't see inside JIT code, build without JIT"
+#endif
+#if PROFILE
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <time.h>
+#endif
+#endif
+
+// 1 = compile in the sampling profiler, which only starts if RIVERSFORTH_SAMPLE
+// is set when riversforth starts (see sample_start)
+#ifndef SAMPLER
+#if defined(__unix__)
+#define SAMPLER 1
+#else
+#define SAMPLER 0
+#endif
+#endif
+#if SAMPLER
+#include <sys/time.h>
+// samples held between dumps; once half of them are taken, docol and the
+// interpreter add them up, so they don't have to wait for SAMPLE-DUMP
+#define SAMPLE_COUNT 16384
+extern uint64_t sample_next;
+void sample_collect(void);
+#define SAMPLE_DRAIN() do { if (__builtin_expect(sample_next >= SAMPLE_COUNT / 2, 0)) sample_collect(); } while (0)
+#else
+#define SAMPLE_DRAIN() ((void)0)
+#endif
 
 typedef intptr_t Cell; // 64 bits or 8 bytes
 typedef void (*CodeFn)(void);
@@ -17,45 +134,394 @@ struct Word {
     const char *name;
     CodeFn code;
     void *params;
+    Word *hash_link; // next word in the same FIND hash bucket
+#if THREADED_GOTO
+    Cell op; // run()'s label for this word, 0 until the first dispatch looks it up
+#endif
+#if PROFILE
+    uint64_t prof_count; // times run
+    uint64_t prof_self;  // time spent in the word itself
+    uint64_t prof_total; // ... and in the words it called
+    uint64_t prof_active; // calls of it not finished yet, so recursion adds to total once
+#endif
 };
 
-// 1024 should actually be way too big.
 /* 
   Quote from Chuck Moore found at https://www.hpmuseum.org/forum/thread-22655-post-195090.html
 
   "This stack which people have so much trouble manipulating should 
   never be more than three or four deep."
 */
-// made these powers of 2 for no real reason
-//#define DATA_STACK_SIZE 1024
-#define DATA_STACK_SIZE 100 // debug easier
-//#define RETURN_STACK_SIZE 1024
-#define RETURN_STACK_SIZE 100 // debug easier
-#define DICTIONARY_SIZE 16384
+// Default stack sizes in cells, --data-stack and --return-stack change them at
+// startup. Both stacks are mmap'd between PROT_NONE guard pages, so running off
+// either end is caught by the MMU instead of a compare in every push and pop
+// (see stack_fault).
+#ifndef DATA_STACK_SIZE
+#define DATA_STACK_SIZE 65536
+#endif
+#ifndef RETURN_STACK_SIZE
+#define RETURN_STACK_SIZE 65536
+#endif
+// The dictionary (word headers and threaded code) and the data space (ALLOT
+// and VARIABLE) are each one big mmap'd reservation, with guard pages after
+// them. Only the pages that get used are backed by memory, so these can be far
+// more than a program will ever need. --dictionary and --data-space change them
+// at startup.
+#ifndef DICTIONARY_SIZE
+#define DICTIONARY_SIZE (256 << 20)
+#endif
+#ifndef DATA_SPACE_SIZE
+#define DATA_SPACE_SIZE (256 << 20)
+#endif
+#define BODY_ALIGN 64 // colon word bodies start on a cache line
 #define TOKEN_SIZE 64
-#define INPUT_BUFFER_SIZE 4096
 
-Cell data_stack[DATA_STACK_SIZE];
-Cell *sp = data_stack + DATA_STACK_SIZE; // grows down. C pointer arithmetic adds DATA_STACK_SIZE*sizeof(Cell)
-
-Cell return_stack[RETURN_STACK_SIZE];
-Cell *rp = return_stack + RETURN_STACK_SIZE; // I'm thinking return_stack is also made of Cells
+// set up by stacks_init(), these are the lowest cell of each stack
+Cell *data_stack;
+Cell *return_stack;
+size_t data_stack_size = DATA_STACK_SIZE; // in cells
+size_t return_stack_size = RETURN_STACK_SIZE;
+Cell *sp = NULL; // grows down from the top of data_stack
+Cell *rp = NULL; // I'm thinking return_stack is also made of Cells
 
 Cell *ip = NULL; // address of next "instruction"
 
-void push(Cell x) { *--sp = x; } // TODO add bounds checking
-Cell pop(void) { return *sp++; } // TODO add bounds checking
+void push(Cell x) { *--sp = x; } // the guard pages do the bounds checking
+Cell pop(void) { return *sp++; }
+
+// set up by dictionary_init()
+char *dictionary;
+char *data_space;
+size_t dictionary_size = DICTIONARY_SIZE; // in bytes
+size_t data_space_size = DATA_SPACE_SIZE;
+int huge_pages = 0; // --huge-pages asks for transparent huge pages for both
+void forth_error(const char *what); // below with the guard pages, doesn't return
 
-// TODO distinguish dictionary and user data space, this is actually user data space
-char dictionary[DICTIONARY_SIZE];
+int in_dictionary(void *p) {
+    return (char *)p >= dictionary && (char *)p < dictionary + dictionary_size;
+}
 Word *latest = NULL; // head of dictionary linked list
 Word *current_word = NULL;
+#if STATS
+struct {
+    uint64_t dispatched;  // words run() has dispatched, with STATS=2
+    uint64_t docol;       // colon words entered
+    uint64_t find_calls;  // FIND lookups
+    uint64_t find_misses; // ... that found nothing
+    uint64_t numbers;     // NUMBER calls that parsed the whole string
+} stats;
+#define STAT(counter) (stats.counter++)
+#else
+#define STAT(counter) ((void)0)
+#endif
+
+#if PROFILE
+// Each colon word that is running has a frame here, pushed where docol pushes
+// ip and popped where EXIT pops it, so when it finishes we know how much of its
+// time went to the words it called.
+typedef struct {
+    Word *word;
+    uint64_t start;    // prof_now() when it started
+    uint64_t children; // time spent in words it called
+} ProfFrame;
+#define PROF_DEPTH 1024
+ProfFrame prof_frames[PROF_DEPTH];
+int prof_depth = 0; // keeps counting past PROF_DEPTH so EXITs still match up
+Word **prof_seen = NULL; // every word that has run, for PROFILE-REPORT
+size_t prof_nseen = 0;
+
+uint64_t prof_now(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc(); // cycles
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec; // nanoseconds
+#endif
+}
+
+void prof_account(Word *w, uint64_t total, uint64_t self) {
+    if (w->prof_count++ == 0) {
+        if ((prof_nseen & (prof_nseen - 1)) == 0) {
+            prof_seen = realloc(prof_seen, (prof_nseen ? prof_nseen * 2 : 64) * sizeof(Word *));
+        }
+        prof_seen[prof_nseen++] = w;
+    }
+    w->prof_self += self;
+    if (w->prof_active == 0) {
+        w->prof_total += total; // the outermost call, which includes the others
+    }
+    if (prof_depth > 0 && prof_depth <= PROF_DEPTH) {
+        prof_frames[prof_depth - 1].children += total;
+    }
+}
+
+void prof_enter(Word *w) {
+    if (prof_depth < PROF_DEPTH) {
+        prof_frames[prof_depth] = (ProfFrame){ w, prof_now(), 0 };
+        w->prof_active++;
+    }
+    prof_depth++;
+}
+
+void prof_leave(void) {
+    if (prof_depth == 0) {
+        return; // an EXIT we didn't see the start of, R> games maybe
+    }
+    prof_depth--;
+    if (prof_depth < PROF_DEPTH) {
+        ProfFrame *f = &prof_frames[prof_depth];
+        uint64_t total = prof_now() - f->start;
+        f->word->prof_active--;
+        prof_account(f->word, total, total - f->children);
+    }
+}
+#endif
+
+// Output.
+//
+// Everything riversforth prints to stdout goes through output_buffer, which is
+// written out with write() when it fills up, at the end of each line when
+// stdout is a terminal (or a --fork-server connection), before reading from a
+// terminal, and at exit. Big strings skip the buffer and go out with writev()
+// along with whatever was already in it.
+#define OUTPUT_BUFFER_SIZE 65536
+char output_buffer[OUTPUT_BUFFER_SIZE];
+size_t output_used = 0;
+int output_line_flush = -1; // flush at each newline, -1 until we've asked isatty()
+
+void output_write(const struct iovec *iov, int n) {
+    // write all of iov, carrying on after short writes
+    struct iovec v[2];
+    memcpy(v, iov, n * sizeof(*v));
+    int i = 0;
+    while (i < n) {
+        ssize_t w = writev(1, v + i, n - i);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            return; // nowhere to send it, nothing useful to do about it
+        }
+        while (i < n && (size_t)w >= v[i].iov_len) {
+            w -= v[i++].iov_len;
+        }
+        if (i < n) {
+            v[i].iov_base = (char *)v[i].iov_base + w;
+            v[i].iov_len -= w;
+        }
+    }
+}
+
+void output_flush(void) {
+    if (output_used) {
+        struct iovec v = { output_buffer, output_used };
+        output_used = 0;
+        output_write(&v, 1);
+    }
+}
+
+void output_newline_check(void) {
+    if (output_line_flush < 0) {
+        output_line_flush = isatty(1);
+    }
+    if (output_line_flush) {
+        output_flush();
+    }
+}
+
+void output_bytes(const char *p, size_t n) {
+    if (n > OUTPUT_BUFFER_SIZE - output_used) {
+        if (n >= OUTPUT_BUFFER_SIZE / 2) {
+            // too big to be worth copying
+            struct iovec v[2] = { { output_buffer, output_used }, { (char *)p, n } };
+            output_used = 0;
+            output_write(v, 2);
+            return;
+        }
+        output_flush();
+    }
+    memcpy(output_buffer + output_used, p, n);
+    output_used += n;
+    if (memchr(p, '\n', n)) {
+        output_newline_check();
+    }
+}
+
+void output_char(char c) {
+    if (output_used == OUTPUT_BUFFER_SIZE) {
+        output_flush();
+    }
+    output_buffer[output_used++] = c;
+    if (c == '\n') {
+        output_newline_check();
+    }
+}
+
+void output_printf(const char *format, ...) {
+    // for messages, numbers from Forth go through format_number instead
+    char text[1024];
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+    if (n > 0) {
+        output_bytes(text, (size_t)n < sizeof(text) ? (size_t)n : sizeof(text) - 1);
+    }
+}
+
+#define NUMBER_SIZE 66 // 64 binary digits, a sign and a NUL
+
+const char digit_chars[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+
+static inline uintptr_t divide_digit(uintptr_t u, Cell radix, char *digit) {
+    // u / radix, with the digit that drops off the end in *digit. The
+    // constant 10 becomes a multiply by its reciprocal, and powers of two are
+    // a shift, which leaves a real divide for the odd bases only.
+    uintptr_t q;
+    if (radix == 10) {
+        q = u / 10;
+    } else if ((radix & (radix - 1)) == 0) {
+        q = u >> __builtin_ctzl(radix);
+    } else {
+        q = u / radix;
+    }
+    *digit = digit_chars[u - q * radix];
+    return q;
+}
+
+static inline Cell good_radix(Cell radix) {
+    return radix < 2 || radix > 36 ? 10 : radix;
+}
+
+char *format_digits(char *end, uintptr_t u, Cell radix) {
+    // the digits of u, backwards from end; returns where they start
+    radix = good_radix(radix);
+    do {
+        u = divide_digit(u, radix, --end);
+    } while (u);
+    return end;
+}
+
+size_t format_number(char *out, Cell n, Cell radix) {
+    // n in radix (10 if it's no good) into out, which has room for
+    // NUMBER_SIZE; returns how long it is
+    char digits[64];
+    char *start = format_digits(digits + sizeof(digits), n < 0 ? -(uintptr_t)n : (uintptr_t)n, radix);
+    size_t len = digits + sizeof(digits) - start;
+    size_t i = 0;
+    if (n < 0) {
+        out[i++] = '-';
+    }
+    memcpy(out + i, start, len);
+    i += len;
+    out[i] = '\0';
+    return i;
+}
+
+extern Cell base; // with the other built in variables below
 
 void do_dot(void) {
-    printf("%ld ", pop());
+    // ( n -- ) print n in BASE and a space
+    char text[NUMBER_SIZE];
+    size_t len = format_number(text, pop(), base);
+    text[len++] = ' ';
+    output_bytes(text, len);
+}
+
+void do_udot(void) {
+    // U. ( u -- ) print u unsigned in BASE and a space
+    char text[NUMBER_SIZE];
+    char *start = format_digits(text + sizeof(text) - 1, pop(), base);
+    text[sizeof(text) - 1] = ' ';
+    output_bytes(start, text + sizeof(text) - start);
+}
+
+void output_right(const char *text, size_t len, Cell width) {
+    // text at the right of width columns (or all of it, if it's wider)
+    static const char spaces[] = "                                ";
+    while (width > (Cell)len) {
+        size_t n = width - len < sizeof(spaces) - 1 ? width - len : sizeof(spaces) - 1;
+        output_bytes(spaces, n);
+        width -= n;
+    }
+    output_bytes(text, len);
+}
+
+void do_dotr(void) {
+    // .R ( n width -- ) print n right aligned in width columns, no space after
+    Cell width = pop();
+    char text[NUMBER_SIZE];
+    size_t len = format_number(text, pop(), base);
+    output_right(text, len, width);
+}
+
+void do_udotr(void) {
+    // U.R ( u width -- ) same for unsigned
+    Cell width = pop();
+    char text[NUMBER_SIZE];
+    char *start = format_digits(text + sizeof(text), pop(), base);
+    output_right(start, text + sizeof(text) - start, width);
+}
+
+// Pictured numeric output, <# ... #> builds a string right to left, at the
+// end of hold_buffer. A cell is 64 bits here and there are no double cell
+// words, so # #S and #> take a single unsigned cell instead of a double.
+#define HOLD_SIZE 256
+char hold_buffer[HOLD_SIZE];
+char *hold_ptr = hold_buffer + HOLD_SIZE;
+
+void hold(char c) {
+    if (hold_ptr == hold_buffer) {
+        forth_error("pictured output overflow");
+    }
+    *--hold_ptr = c;
+}
+
+void do_less_sharp(void) {
+    // <# ( -- ) start a new picture
+    hold_ptr = hold_buffer + HOLD_SIZE;
+}
+
+void do_sharp(void) {
+    // # ( u -- u/BASE ) add the next digit
+    char digit;
+    sp[0] = divide_digit(sp[0], good_radix(base), &digit);
+    hold(digit);
+}
+
+void do_sharp_s(void) {
+    // #S ( u -- 0 ) add the rest of the digits, at least one
+    Cell radix = good_radix(base);
+    uintptr_t u = sp[0];
+    char digit;
+    do {
+        u = divide_digit(u, radix, &digit);
+        hold(digit);
+    } while (u);
+    sp[0] = 0;
+}
+
+void do_hold(void) {
+    // HOLD ( c -- ) add c
+    hold(pop());
+}
+
+void do_sign(void) {
+    // SIGN ( n -- ) add a - if n is negative
+    if (pop() < 0) {
+        hold('-');
+    }
+}
+
+void do_sharp_greater(void) {
+    // #> ( u -- addr length ) the picture, until the next <#
+    sp[0] = (Cell)hold_ptr;
+    push(hold_buffer + HOLD_SIZE - hold_ptr);
 }
 
 void do_exit(void) {
+#if PROFILE
+    prof_leave();
+#endif
     ip = (Cell *)rp[0];
     rp++;
     // ip is Cell *
@@ -361,13 +827,403 @@ void do_ccopy(void) {
     push((Cell)dst);
 }
 
+// Memory blocks. The copies, fills and searches go to the C library, which has
+// vector versions of all of them. Lengths are cells, and one that's 0 or less
+// does nothing.
+
 void do_cmove(void) {
+    // CMOVE ( src dst length -- ) copy bytes starting from the low end. If dst
+    // is a little way into src, a byte at a time copy repeats the first dst-src
+    // bytes over and over, so that happens here too, with doubling memcpys.
+    Cell length = pop();
+    uint8_t *dst = (uint8_t *)pop();
+    uint8_t *src = (uint8_t *)pop();
+    if (length <= 0) return;
+    if (dst <= src || dst >= src + length) {
+        memmove(dst, src, length);
+        return;
+    }
+    size_t period = dst - src;
+    size_t done = 0; // dst[0 .. done) is already right
+    while (done < (size_t)length) {
+        size_t n = period + done; // repeats that fit between src and the end of the done part
+        if (n > length - done) n = length - done;
+        memcpy(dst + done, src, n);
+        done += n;
+    }
+}
+
+void do_cmove_up(void) {
+    // CMOVE> ( src dst length -- ) copy bytes starting from the high end. The
+    // mirror image of CMOVE: if src is a little way into dst, it repeats the
+    // last src-dst bytes.
     Cell length = pop();
     uint8_t *dst = (uint8_t *)pop();
     uint8_t *src = (uint8_t *)pop();
-    for (int i = 0; i < length; i++) {
-        dst[i] = src[i];
+    if (length <= 0) return;
+    if (src <= dst || src >= dst + length) {
+        memmove(dst, src, length);
+        return;
+    }
+    size_t period = src - dst;
+    size_t done = 0; // the last done bytes of dst are already right
+    while (done < (size_t)length) {
+        size_t n = period + done;
+        if (n > length - done) n = length - done;
+        memcpy(dst + length - done - n, src + length - n, n);
+        done += n;
+    }
+}
+
+void do_move(void) {
+    // MOVE ( src dst length -- ) copy bytes as if through a separate buffer
+    Cell length = pop();
+    void *dst = (void *)pop();
+    void *src = (void *)pop();
+    if (length > 0) memmove(dst, src, length);
+}
+
+void do_fill(void) {
+    // FILL ( addr length c -- )
+    int c = pop();
+    Cell length = pop();
+    void *addr = (void *)pop();
+    if (length > 0) memset(addr, c, length);
+}
+
+void do_erase(void) {
+    // ERASE ( addr length -- ) fill with zeros
+    Cell length = pop();
+    void *addr = (void *)pop();
+    if (length > 0) memset(addr, 0, length);
+}
+
+void do_move_cells(void) {
+    // MOVE-CELLS ( src dst n -- ) MOVE for n cells
+    Cell n = pop();
+    void *dst = (void *)pop();
+    void *src = (void *)pop();
+    if (n > 0) memmove(dst, src, n * sizeof(Cell));
+}
+
+void do_fill_cells(void) {
+    // FILL-CELLS ( addr n x -- ) store x in n cells (the compiler vectorizes this)
+    Cell x = pop();
+    Cell n = pop();
+    Cell *addr = (Cell *)pop();
+    for (Cell i = 0; i < n; i++) {
+        addr[i] = x;
+    }
+}
+
+void do_compare(void) {
+    // COMPARE ( addr1 length1 addr2 length2 -- n ) -1, 0 or 1 as the first
+    // string is before, the same as or after the second, bytes as unsigned,
+    // and a string before any longer one it's the start of
+    Cell length2 = pop();
+    uint8_t *s2 = (uint8_t *)pop();
+    Cell length1 = pop();
+    uint8_t *s1 = (uint8_t *)pop();
+    if (length1 < 0) length1 = 0;
+    if (length2 < 0) length2 = 0;
+    int c = memcmp(s1, s2, length1 < length2 ? length1 : length2);
+    if (c == 0) c = (length1 > length2) - (length1 < length2);
+    push(c < 0 ? -1 : c > 0);
+}
+
+void do_search(void) {
+    // SEARCH ( addr1 length1 addr2 length2 -- addr3 length3 flag ) find the
+    // second string in the first. If it's there, addr3 length3 is the rest of
+    // the first string from where it starts and flag is 1, otherwise the first
+    // string and 0. memchr finds places the first byte matches.
+    Cell length2 = pop();
+    uint8_t *s2 = (uint8_t *)pop();
+    Cell length1 = sp[0];
+    uint8_t *s1 = (uint8_t *)sp[1];
+    if (length2 <= 0) {
+        push(1);
+        return;
+    }
+    if (length1 < length2) {
+        push(0);
+        return;
+    }
+    uint8_t *p = s1;
+    uint8_t *last = s1 + length1 - length2; // the last place it could start
+    while (p <= last && (p = memchr(p, s2[0], last - p + 1)) != NULL) {
+        if (memcmp(p + 1, s2 + 1, length2 - 1) == 0) {
+            sp[1] = (Cell)p;
+            sp[0] = s1 + length1 - p;
+            push(1);
+            return;
+        }
+        p++;
+    }
+    push(0);
+}
+
+// Cell arrays. Words for number crunching over (address, count) arrays of
+// cells, so a loop over a million cells is one word instead of a million trips
+// around @ + ! in the interpreter. Each kernel has a plain C version and, on
+// x86-64, an AVX2 one that does four cells at a time; cells_init() picks one
+// or the other at startup, depending on the CPU. Arithmetic wraps around like
+// + - and * do. dst can be the same array as a source, but shouldn't partly
+// overlap one.
+
+typedef void (*CellsBinary)(Cell *dst, const Cell *a, const Cell *b, Cell x, size_t n);
+enum { V_ADD, V_SUB, V_MUL, V_AND, V_OR, V_XOR, V_EQ, V_LT, V_GT, V_OPS };
+
+#define V_ADD_1(x, y) ((Cell)((uintptr_t)(x) + (uintptr_t)(y)))
+#define V_SUB_1(x, y) ((Cell)((uintptr_t)(x) - (uintptr_t)(y)))
+#define V_MUL_1(x, y) ((Cell)((uintptr_t)(x) * (uintptr_t)(y)))
+#define V_AND_1(x, y) ((x) & (y))
+#define V_OR_1(x, y)  ((x) | (y))
+#define V_XOR_1(x, y) ((x) ^ (y))
+#define V_EQ_1(x, y)  (-(Cell)((x) == (y))) // comparisons give masks, -1 or 0
+#define V_LT_1(x, y)  (-(Cell)((x) < (y)))
+#define V_GT_1(x, y)  (-(Cell)((x) > (y)))
+
+// dst[i] = a[i] op b[i], or a[i] op x if b is NULL
+#define CELLS_SCALAR(op) \
+    void cells_##op##_scalar(Cell *dst, const Cell *a, const Cell *b, Cell x, size_t n) { \
+        if (b) { \
+            for (size_t i = 0; i < n; i++) dst[i] = op##_1(a[i], b[i]); \
+        } else { \
+            for (size_t i = 0; i < n; i++) dst[i] = op##_1(a[i], x); \
+        } \
+    }
+CELLS_SCALAR(V_ADD) CELLS_SCALAR(V_SUB) CELLS_SCALAR(V_MUL)
+CELLS_SCALAR(V_AND) CELLS_SCALAR(V_OR)  CELLS_SCALAR(V_XOR)
+CELLS_SCALAR(V_EQ)  CELLS_SCALAR(V_LT)  CELLS_SCALAR(V_GT)
+
+Cell cells_sum_scalar(const Cell *a, size_t n) {
+    uintptr_t sum = 0;
+    for (size_t i = 0; i < n; i++) sum += a[i];
+    return sum;
+}
+
+Cell cells_min_scalar(const Cell *a, size_t n) {
+    Cell min = INTPTR_MAX;
+    for (size_t i = 0; i < n; i++) min = a[i] < min ? a[i] : min;
+    return min;
+}
+
+Cell cells_max_scalar(const Cell *a, size_t n) {
+    Cell max = INTPTR_MIN;
+    for (size_t i = 0; i < n; i++) max = a[i] > max ? a[i] : max;
+    return max;
+}
+
+Cell cells_dot_scalar(const Cell *a, const Cell *b, size_t n) {
+    uintptr_t dot = 0;
+    for (size_t i = 0; i < n; i++) dot += (uintptr_t)a[i] * b[i];
+    return dot;
+}
+
+void cells_scan_scalar(Cell *dst, const Cell *a, size_t n, Cell total) {
+    // running totals of a, starting from total
+    uintptr_t t = total;
+    for (size_t i = 0; i < n; i++) dst[i] = t += a[i];
+}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define AVX2 __attribute__((target("avx2")))
+
+AVX2 static inline __m256i mul_epi64(__m256i x, __m256i y) {
+    // AVX2 only multiplies 32 bit halves, so the low 64 bits of x*y are
+    // xlo*ylo + (xhi*ylo + xlo*yhi) << 32
+    __m256i lo = _mm256_mul_epu32(x, y);
+    __m256i cross = _mm256_add_epi64(_mm256_mul_epu32(_mm256_srli_epi64(x, 32), y),
+                                     _mm256_mul_epu32(x, _mm256_srli_epi64(y, 32)));
+    return _mm256_add_epi64(lo, _mm256_slli_epi64(cross, 32));
+}
+
+#define V_ADD_4(x, y) _mm256_add_epi64(x, y)
+#define V_SUB_4(x, y) _mm256_sub_epi64(x, y)
+#define V_MUL_4(x, y) mul_epi64(x, y)
+#define V_AND_4(x, y) _mm256_and_si256(x, y)
+#define V_OR_4(x, y)  _mm256_or_si256(x, y)
+#define V_XOR_4(x, y) _mm256_xor_si256(x, y)
+#define V_EQ_4(x, y)  _mm256_cmpeq_epi64(x, y)
+#define V_LT_4(x, y)  _mm256_cmpgt_epi64(y, x)
+#define V_GT_4(x, y)  _mm256_cmpgt_epi64(x, y)
+
+#define LOAD4(p) _mm256_loadu_si256((const __m256i *)(p))
+#define STORE4(p, v) _mm256_storeu_si256((__m256i *)(p), v)
+
+// four at a time, and the C version for the last few
+#define CELLS_AVX2(op) \
+    AVX2 void cells_##op##_avx2(Cell *dst, const Cell *a, const Cell *b, Cell x, size_t n) { \
+        size_t i = 0; \
+        if (b) { \
+            for (; i + 4 <= n; i += 4) STORE4(dst + i, op##_4(LOAD4(a + i), LOAD4(b + i))); \
+        } else { \
+            __m256i xs = _mm256_set1_epi64x(x); \
+            for (; i + 4 <= n; i += 4) STORE4(dst + i, op##_4(LOAD4(a + i), xs)); \
+        } \
+        cells_##op##_scalar(dst + i, a + i, b ? b + i : NULL, x, n - i); \
+    }
+CELLS_AVX2(V_ADD) CELLS_AVX2(V_SUB) CELLS_AVX2(V_MUL)
+CELLS_AVX2(V_AND) CELLS_AVX2(V_OR)  CELLS_AVX2(V_XOR)
+CELLS_AVX2(V_EQ)  CELLS_AVX2(V_LT)  CELLS_AVX2(V_GT)
+
+AVX2 static inline Cell lanes_sum(__m256i v) {
+    Cell l[4];
+    STORE4(l, v);
+    return (uintptr_t)l[0] + l[1] + l[2] + l[3];
+}
+
+AVX2 Cell cells_sum_avx2(const Cell *a, size_t n) {
+    __m256i sum = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) sum = _mm256_add_epi64(sum, LOAD4(a + i));
+    return (uintptr_t)lanes_sum(sum) + cells_sum_scalar(a + i, n - i);
+}
+
+AVX2 Cell cells_min_avx2(const Cell *a, size_t n) {
+    __m256i min = _mm256_set1_epi64x(INTPTR_MAX);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i x = LOAD4(a + i);
+        min = _mm256_blendv_epi8(min, x, _mm256_cmpgt_epi64(min, x));
+    }
+    Cell l[4];
+    STORE4(l, min);
+    Cell rest = cells_min_scalar(a + i, n - i);
+    for (int k = 0; k < 4; k++) rest = l[k] < rest ? l[k] : rest;
+    return rest;
+}
+
+AVX2 Cell cells_max_avx2(const Cell *a, size_t n) {
+    __m256i max = _mm256_set1_epi64x(INTPTR_MIN);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i x = LOAD4(a + i);
+        max = _mm256_blendv_epi8(max, x, _mm256_cmpgt_epi64(x, max));
+    }
+    Cell l[4];
+    STORE4(l, max);
+    Cell rest = cells_max_scalar(a + i, n - i);
+    for (int k = 0; k < 4; k++) rest = l[k] > rest ? l[k] : rest;
+    return rest;
+}
+
+AVX2 Cell cells_dot_avx2(const Cell *a, const Cell *b, size_t n) {
+    __m256i dot = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) dot = _mm256_add_epi64(dot, mul_epi64(LOAD4(a + i), LOAD4(b + i)));
+    return (uintptr_t)lanes_sum(dot) + cells_dot_scalar(a + i, b + i, n - i);
+}
+
+AVX2 void cells_scan_avx2(Cell *dst, const Cell *a, size_t n, Cell total) {
+    // within four cells: add each one's left neighbour, then the pair two to
+    // the left, then the total of everything before the four
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i carry = _mm256_set1_epi64x(total);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i x = LOAD4(a + i);
+        x = _mm256_add_epi64(x, _mm256_blend_epi32(_mm256_permute4x64_epi64(x, _MM_SHUFFLE(2, 1, 0, 0)), zero, 0x03));
+        x = _mm256_add_epi64(x, _mm256_blend_epi32(_mm256_permute4x64_epi64(x, _MM_SHUFFLE(1, 0, 0, 0)), zero, 0x0F));
+        x = _mm256_add_epi64(x, carry);
+        STORE4(dst + i, x);
+        carry = _mm256_permute4x64_epi64(x, _MM_SHUFFLE(3, 3, 3, 3));
     }
+    cells_scan_scalar(dst + i, a + i, n - i, i ? dst[i - 1] : total);
+}
+#endif
+
+CellsBinary cells_binary[V_OPS] = {
+    cells_V_ADD_scalar, cells_V_SUB_scalar, cells_V_MUL_scalar,
+    cells_V_AND_scalar, cells_V_OR_scalar,  cells_V_XOR_scalar,
+    cells_V_EQ_scalar,  cells_V_LT_scalar,  cells_V_GT_scalar,
+};
+Cell (*cells_sum)(const Cell *a, size_t n) = cells_sum_scalar;
+Cell (*cells_min)(const Cell *a, size_t n) = cells_min_scalar;
+Cell (*cells_max)(const Cell *a, size_t n) = cells_max_scalar;
+Cell (*cells_dot)(const Cell *a, const Cell *b, size_t n) = cells_dot_scalar;
+void (*cells_scan)(Cell *dst, const Cell *a, size_t n, Cell total) = cells_scan_scalar;
+
+void cells_init(void) {
+    // switch to the AVX2 kernels if this CPU has it
+#if defined(__x86_64__) && defined(__GNUC__)
+    if (__builtin_cpu_supports("avx2")) {
+        CellsBinary avx2[V_OPS] = {
+            cells_V_ADD_avx2, cells_V_SUB_avx2, cells_V_MUL_avx2,
+            cells_V_AND_avx2, cells_V_OR_avx2,  cells_V_XOR_avx2,
+            cells_V_EQ_avx2,  cells_V_LT_avx2,  cells_V_GT_avx2,
+        };
+        memcpy(cells_binary, avx2, sizeof(avx2));
+        cells_sum = cells_sum_avx2;
+        cells_min = cells_min_avx2;
+        cells_max = cells_max_avx2;
+        cells_dot = cells_dot_avx2;
+        cells_scan = cells_scan_avx2;
+    }
+#endif
+}
+
+size_t pop_count(void) {
+    // an array length, with 0 or less meaning an empty array
+    Cell n = pop();
+    return n > 0 ? n : 0;
+}
+
+void cells_op(int op, int scalar) {
+    // ( a b dst n -- ) or, with scalar, ( a x dst n -- )
+    size_t n = pop_count();
+    Cell *dst = (Cell *)pop();
+    Cell b = pop();
+    const Cell *a = (const Cell *)pop();
+    cells_binary[op](dst, a, scalar ? NULL : (const Cell *)b, b, n);
+}
+
+void do_vadd(void)  { cells_op(V_ADD, 0); }
+void do_vsub(void)  { cells_op(V_SUB, 0); }
+void do_vmul(void)  { cells_op(V_MUL, 0); }
+void do_vand(void)  { cells_op(V_AND, 0); }
+void do_vor(void)   { cells_op(V_OR, 0); }
+void do_vxor(void)  { cells_op(V_XOR, 0); }
+void do_vadds(void) { cells_op(V_ADD, 1); }
+void do_vsubs(void) { cells_op(V_SUB, 1); }
+void do_vmuls(void) { cells_op(V_MUL, 1); }
+void do_vands(void) { cells_op(V_AND, 1); }
+void do_vors(void)  { cells_op(V_OR, 1); }
+void do_vxors(void) { cells_op(V_XOR, 1); }
+void do_veq(void)   { cells_op(V_EQ, 0); }
+void do_vlt(void)   { cells_op(V_LT, 0); }
+void do_vgt(void)   { cells_op(V_GT, 0); }
+
+void do_vsum(void) {
+    // VSUM ( a n -- sum )
+    size_t n = pop_count();
+    sp[0] = cells_sum((const Cell *)sp[0], n);
+}
+
+void do_vmin(void) {
+    // VMIN ( a n -- min ) the largest number there is for no cells
+    size_t n = pop_count();
+    sp[0] = cells_min((const Cell *)sp[0], n);
+}
+
+void do_vmax(void) {
+    // VMAX ( a n -- max ) the smallest number there is for no cells
+    size_t n = pop_count();
+    sp[0] = cells_max((const Cell *)sp[0], n);
+}
+
+void do_vdot(void) {
+    // VDOT ( a b n -- sum of a[i]*b[i] )
+    size_t n = pop_count();
+    const Cell *b = (const Cell *)pop();
+    sp[0] = cells_dot((const Cell *)sp[0], b, n);
+}
+
+void do_vscan(void) {
+    // VSCAN ( a dst n -- ) dst[i] = a[0] + ... + a[i]
+    size_t n = pop_count();
+    Cell *dst = (Cell *)pop();
+    cells_scan(dst, (const Cell *)pop(), n, 0);
 }
 
 
@@ -375,6 +1231,11 @@ void docol(void) {
     rp--; // Cell *
     *rp = (Cell)ip; // rp is Cell *.  *rp is Cell.  ip is Cell *.  Cast to Cell.
     ip = (Cell *)current_word->params; // ip is Cell *. current_word is Word *. params is... void *!
+    STAT(docol);
+    SAMPLE_DRAIN();
+#if PROFILE
+    prof_enter(current_word);
+#endif
 }
 
 //                      link  fl name      code          params (e.g.docol code body)
@@ -424,8 +1285,47 @@ Word word_storebyte = { NULL, 0, "C!",     do_storebyte, NULL };
 Word word_fetchbyte = { NULL, 0, "C@",     do_fetchbyte, NULL };
 Word word_ccopy     = { NULL, 0, "C@C!",   do_ccopy,     NULL };
 Word word_cmove     = { NULL, 0, "CMOVE",  do_cmove,     NULL };
+Word word_cmove_up  = { NULL, 0, "CMOVE>", do_cmove_up,  NULL };
+Word word_move      = { NULL, 0, "MOVE",   do_move,      NULL };
+Word word_fill      = { NULL, 0, "FILL",   do_fill,      NULL };
+Word word_erase     = { NULL, 0, "ERASE",  do_erase,     NULL };
+Word word_move_cells = { NULL, 0, "MOVE-CELLS", do_move_cells, NULL };
+Word word_fill_cells = { NULL, 0, "FILL-CELLS", do_fill_cells, NULL };
+Word word_compare   = { NULL, 0, "COMPARE", do_compare,  NULL };
+Word word_search    = { NULL, 0, "SEARCH", do_search,    NULL };
+
+Word word_vadd  = { NULL, 0, "V+",    do_vadd,  NULL };
+Word word_vsub  = { NULL, 0, "V-",    do_vsub,  NULL };
+Word word_vmul  = { NULL, 0, "V*",    do_vmul,  NULL };
+Word word_vand  = { NULL, 0, "VAND",  do_vand,  NULL };
+Word word_vor   = { NULL, 0, "VOR",   do_vor,   NULL };
+Word word_vxor  = { NULL, 0, "VXOR",  do_vxor,  NULL };
+Word word_vadds = { NULL, 0, "V+S",   do_vadds, NULL };
+Word word_vsubs = { NULL, 0, "V-S",   do_vsubs, NULL };
+Word word_vmuls = { NULL, 0, "V*S",   do_vmuls, NULL };
+Word word_vands = { NULL, 0, "VANDS", do_vands, NULL };
+Word word_vors  = { NULL, 0, "VORS",  do_vors,  NULL };
+Word word_vxors = { NULL, 0, "VXORS", do_vxors, NULL };
+Word word_veq   = { NULL, 0, "V=",    do_veq,   NULL };
+Word word_vlt   = { NULL, 0, "V<",    do_vlt,   NULL };
+Word word_vgt   = { NULL, 0, "V>",    do_vgt,   NULL };
+Word word_vsum  = { NULL, 0, "VSUM",  do_vsum,  NULL };
+Word word_vmin  = { NULL, 0, "VMIN",  do_vmin,  NULL };
+Word word_vmax  = { NULL, 0, "VMAX",  do_vmax,  NULL };
+Word word_vdot  = { NULL, 0, "VDOT",  do_vdot,  NULL };
+Word word_vscan = { NULL, 0, "VSCAN", do_vscan, NULL };
 
 Word word_dot     = { NULL, 0, ".",      do_dot,     NULL };
+Word word_udot    = { NULL, 0, "U.",     do_udot,    NULL };
+Word word_dotr    = { NULL, 0, ".R",     do_dotr,    NULL };
+Word word_udotr   = { NULL, 0, "U.R",    do_udotr,   NULL };
+
+Word word_less_sharp    = { NULL, 0, "<#",   do_less_sharp,    NULL };
+Word word_sharp         = { NULL, 0, "#",    do_sharp,         NULL };
+Word word_sharp_s       = { NULL, 0, "#S",   do_sharp_s,       NULL };
+Word word_hold          = { NULL, 0, "HOLD", do_hold,          NULL };
+Word word_sign          = { NULL, 0, "SIGN", do_sign,          NULL };
+Word word_sharp_greater = { NULL, 0, "#>",   do_sharp_greater, NULL };
 
 Word *double_body[] = { &word_dup, &word_add, &word_exit };
 Word word_double =    { NULL, 0, "DOUBLE",    docol, double_body };
@@ -449,12 +1349,14 @@ void do_var_latest(void) {
     push((Cell)&latest);
 }
 
-void *here = dictionary;
+void *here = NULL; // dictionary_init() points it at the dictionary
 void do_var_here(void) {
     // Points to the next free byte of memory.  When compiling, compiled words go here.
     push((Cell)&here);
 }
 
+void *data_here = NULL; // next free byte of the data space, ALLOT moves it
+
 Cell *s0; // initial value of sp
 void do_var_s0(void) {
     // Stores the address of the top of the parameter stack.
@@ -503,11 +1405,33 @@ void do_con_f_hidden(void) {
     push(F_HIDDEN);
 }
 
+#define F_INLINE 4
+void do_con_f_inline(void) {
+    // F_INLINE, always inline this word when it is compiled.
+    push(F_INLINE);
+}
+
+#define F_NOINLINE 8
+void do_con_f_noinline(void) {
+    // F_NOINLINE, never inline this word.
+    push(F_NOINLINE);
+}
+
+// set on colon words whose code field is JIT output; params is still the
+// threaded body, so they can be inlined and looked through like any colon word
+#define F_JIT 16
+
+int is_docol(Word *w) {
+    return w->code == docol || (w->flags & F_JIT);
+}
+
 Word word_do_con_version  = { NULL, 0, "VERSION",  do_con_version, NULL };
 Word word_do_con_r0       = { NULL, 0, "R0",       do_con_r0,      NULL };
 Word word_do_con_docol    = { NULL, 0, "DOCOL",    do_con_docol,   NULL };
 Word word_do_con_f_immed  = { NULL, 0, "F_IMMED",  do_con_f_immed, NULL };
 Word word_do_con_f_hidden = { NULL, 0, "F_HIDDEN", do_con_f_hidden, NULL };
+Word word_do_con_f_inline = { NULL, 0, "F_INLINE", do_con_f_inline, NULL };
+Word word_do_con_f_noinline = { NULL, 0, "F_NOINLINE", do_con_f_noinline, NULL };
 
 // return stack related words
 
@@ -563,135 +1487,564 @@ Word word_dspstore = { NULL, 0, "DSP!",  do_dspstore, NULL };
 
 // input / output
 
-// we could probably just use getchar or something here instead
-// TODO try that out
-// moved to a function since it's also used by WORD
-char input_buffer[INPUT_BUFFER_SIZE];
-char currkey = 0;
-char bufftop = 0;
-char get_key(void) {
-    while (currkey >= bufftop) {
-        // refill buffer
-        if (!fgets(input_buffer, sizeof(input_buffer), stdin)) {
-            // stdin has closed
-            exit(0);
+// Input comes from an InputSource: a buffer with a cursor, and maybe a file
+// descriptor to read more from. Pipes and terminals are read in big blocks,
+// regular files (stdin redirected from one, or files named on the command
+// line) are mmap'd whole, and interpret() points one at a C string. Whatever
+// hasn't been used yet is moved to the front of the buffer before reading
+// more, so a word or line can span two reads, and the buffer grows if a single
+// line doesn't fit.
+#define INPUT_BLOCK_SIZE (1 << 20)
+
+typedef struct {
+    char *buffer;
+    size_t currkey; // next character
+    size_t bufftop; // end of what's been read
+    size_t size;    // room in buffer, 0 if it isn't ours to read into
+    int fd;         // where it comes from, -1 for a string
+    int tty;        // fd is a terminal
+} InputSource;
+
+InputSource input = { "", 0, 0, 0, -1, 0 }; // main() points it at stdin for the REPL
+
+int refill(void) {
+    // read more input after what's left, returns 0 at the end of it
+    if (input.size == 0) {
+        return 0;
+    }
+    char last = input.bufftop ? input.buffer[input.bufftop - 1] : '\n';
+    memmove(input.buffer, input.buffer + input.currkey, input.bufftop - input.currkey);
+    input.bufftop -= input.currkey;
+    input.currkey = 0;
+    if (input.bufftop == input.size) {
+        char *bigger = realloc(input.buffer, input.size * 2);
+        if (bigger == NULL) {
+            forth_error("line too long");
+        }
+        input.buffer = bigger;
+        input.size *= 2;
+    }
+    if (input.tty) {
+        output_flush(); // whatever we printed should be there before we wait for more
+    }
+    ssize_t n;
+    do {
+        n = read(input.fd, input.buffer + input.bufftop, input.size - input.bufftop);
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0) {
+        if (last != '\n') {
+            // finish the last line, so a word right at the end still ends
+            input.buffer[input.bufftop++] = '\n';
+            return 1;
         }
-        currkey = 0;
-        bufftop = strlen(input_buffer);
+        return 0;
     }
-    return input_buffer[currkey++];
+    input.bufftop += n;
+    return 1;
 }
 
-void do_key(void) {
-    push(get_key());
+InputSource input_from_fd(int fd) {
+    // mmap fd if it's a regular file, otherwise set up to read() it in blocks
+    InputSource in = { "", 0, 0, 0, fd, isatty(fd) };
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        if (st.st_size > 0) {
+            char *m = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (m != MAP_FAILED && m[st.st_size - 1] != '\n') {
+                munmap(m, st.st_size); // read() it instead, refill() adds the last newline
+            } else if (m != MAP_FAILED) {
+                madvise(m, st.st_size, MADV_SEQUENTIAL);
+                in.buffer = m;
+                in.bufftop = st.st_size;
+                return in;
+            }
+        } else {
+            return in;
+        }
+    }
+    in.buffer = malloc(INPUT_BLOCK_SIZE);
+    if (in.buffer == NULL) {
+        perror("input buffer");
+        exit(1);
+    }
+    in.size = INPUT_BLOCK_SIZE;
+    return in;
 }
 
-void do_emit(void) {
-    putchar(pop());
+void input_close(InputSource *in) {
+    if (in->size) {
+        free(in->buffer);
+    } else if (in->bufftop) {
+        munmap(in->buffer, in->bufftop);
+    }
 }
 
-char word_buffer[TOKEN_SIZE]; // TODO add bounds checking
-void do_word(void) {
-    int length = 0;
-    char c = get_key();
-    if (c == '\\') {
-        // start of comment, skip until after next newline
-        while (c != '\n') {
-            c = get_key();
-        }
-    }
-    // skip whitespace
-    // JonesForth only checks for space ' ' so I'm not sure how it's handling newlines
-    // it only seems to deal with it after comments
-    // but that's clearly not the case.
-    // Perhaps it will become clear later.
-    while (isspace(c)) {
-        c = get_key();
-    }
-    while (!isspace(c)) {
-        word_buffer[length++] = c;
-        c = get_key();
-    }
-    word_buffer[length] = '\0';
-    push((Cell)word_buffer);
-    push(length);
+void input_ended(void) {
+    // ran out of input in the middle of something
+    if (input.fd == 0) {
+        exit(0); // stdin has closed
+    }
+    forth_error("unexpected end of input");
 }
 
-void do_number(void) {
-    // clearly C has functions to do this already
-    // we could just use that, at least for certain standard bases
-    int length = pop();
-    char *s = (char *)pop();
-    int unparsed = length;
-    int number = 0;
-    int negative = 0;
+char get_key(void) {
+    if (input.currkey >= input.bufftop && !refill()) {
+        input_ended();
+    }
+    return input.buffer[input.currkey++];
+}
 
-    if (length == 0) {
-        // trying to parse a zero-length string is an error, but will return 0.
-        push(0);
-        push(1); // setting this to 1 to indicate an error. Not sure if this will cause a problem.
-        return;
+// Finding where words start and end. Whitespace is any byte up to ' ', which
+// is one unsigned compare per byte, so scan_bytes can test 32 (AVX2, if the
+// CPU has it), 16 (SSE2) or 8 (arithmetic on a 64 bit integer) bytes at a
+// time, then the last few one at a time.
+#define WHITESPACE(c) ((unsigned char)(c) <= ' ')
+
+#if defined(__x86_64__) && defined(__GNUC__)
+__attribute__((target("avx2")))
+size_t scan_bytes_avx2(const char *p, size_t n, int want_space) {
+    // first i at or after where scan_bytes got to whose WHITESPACE() is want_space
+    const __m256i limit = _mm256_set1_epi8(' ');
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i x = _mm256_loadu_si256((const __m256i *)(p + i));
+        uint32_t mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_max_epu8(x, limit), limit));
+        if (!want_space) mask = ~mask;
+        if (mask) return i + __builtin_ctz(mask);
     }
-    for (int i = 0; i < length; i++) {
-        if (i == 0 && s[i] == '-') {
-            if (length == 1) {
-                // only "-" as a number is an error
-                push(0);
-                push(1); // unparsed non-zero indicates error
-                return;
-            }
-            negative = 1; // negative is true
-            unparsed--;
-            continue;
+    return i;
+}
+#endif
+
+#if defined(__GNUC__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define SCAN_SWAR 1
+size_t scan_bytes_swar(const char *p, size_t n, int want_space) {
+    // scan_bytes without SSE2. Compiled either way, so the tests can check it.
+    // The high bit of each byte of m says whether it matched; a borrow can
+    // only make a byte above a real match look like one too, so the lowest
+    // is right
+    const uint64_t ones = 0x0101010101010101ull;
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        uint64_t x, m;
+        memcpy(&x, p + i, 8);
+        if (want_space) {
+            m = (x - ones * (' ' + 1)) & ~x & ones * 0x80; // bytes < ' ' + 1
+        } else {
+            m = ((x + ones * (127 - ' ')) | x) & ones * 0x80; // bytes > ' '
         }
-        int digit = s[i];
-        // convert digit, regardless of base (up to base 36 anyway)
-        if (isdigit(digit)) { // 0 to 9
-            digit -= '0';
+        if (m) return i + __builtin_ctzll(m) / 8;
+    }
+    for (; i < n; i++) {
+        if (WHITESPACE(p[i]) == want_space) return i;
+    }
+    return n;
+}
+#else
+#define SCAN_SWAR 0
+#endif
+
+size_t scan_bytes(const char *p, size_t n, int want_space) {
+    // index of the first of p's n bytes that is (want_space) or isn't whitespace, or n
+    size_t i = 0;
+#if defined(__x86_64__) && defined(__GNUC__)
+    static int avx2 = -1;
+    if (avx2 < 0) {
+        avx2 = __builtin_cpu_supports("avx2");
+    }
+    if (avx2 && n >= 32) {
+        i = scan_bytes_avx2(p, n, want_space);
+        if (i + 32 <= n) return i;
+    }
+#endif
+#if defined(__SSE2__)
+    const __m128i limit = _mm_set1_epi8(' ');
+    for (; i + 16 <= n; i += 16) {
+        __m128i x = _mm_loadu_si128((const __m128i *)(p + i));
+        unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_max_epu8(x, limit), limit));
+        if (!want_space) mask = ~mask & 0xFFFF;
+        if (mask) return i + __builtin_ctz(mask);
+    }
+#elif SCAN_SWAR
+    return i + scan_bytes_swar(p + i, n - i, want_space);
+#endif
+    for (; i < n; i++) {
+        if (WHITESPACE(p[i]) == want_space) return i;
+    }
+    return n;
+}
+
+void do_key(void) {
+    push(get_key());
+}
+
+void do_emit(void) {
+    output_char(pop());
+}
+
+void do_tell(void) {
+    // ( addr length -- ) print a string
+    size_t length = pop();
+    output_bytes((char *)pop(), length);
+}
+
+void do_word(void) {
+    // ( -- addr length ) of the next word, straight out of the input buffer, so
+    // it's only there until the next WORD or KEY (which could read more input
+    // over it), like JonesForth's buffer. CREATE and FIND don't need it to be
+    // NUL terminated.
+    // A \ where a word would start is a comment, skip until after next newline
+    // and look again, since the next line can be a comment as well.
+    while (1) {
+        input.currkey += scan_bytes(input.buffer + input.currkey, input.bufftop - input.currkey, 0);
+        if (input.currkey >= input.bufftop) {
+            if (!refill()) {
+                input_ended();
+            }
+            continue;
         }
-        else if (digit >= 'A' && digit <= 'Z') {
-            digit -= 'A';
-            digit += 10;
+        if (input.buffer[input.currkey] != '\\') {
+            break;
         }
-        else if (digit >= 'a' && digit <= 'z') {
-            digit -= 'a';
-            digit += 10;
+        char *nl;
+        while (!(nl = memchr(input.buffer + input.currkey, '\n', input.bufftop - input.currkey))) {
+            input.currkey = input.bufftop;
+            if (!refill()) {
+                input_ended();
+            }
         }
-        // check if it fits within base
-        if (digit >= base) {
-            push(number);
-            push(unparsed);
-            return;
+        input.currkey = nl - input.buffer;
+    }
+    // the word goes up to the next whitespace, which may not have been read yet
+    // (refill() keeps everything from currkey on, so the start of it stays)
+    size_t length = 0;
+    while (1) {
+        length += scan_bytes(input.buffer + input.currkey + length, input.bufftop - input.currkey - length, 1);
+        if (input.currkey + length < input.bufftop || !refill()) {
+            break;
         }
-        number *= base;
-        number += digit;
-        unparsed--;
     }
+    char *word = input.buffer + input.currkey;
+    input.currkey += length;
+    // step over the space after it, but leave the end of the line for words_remain()
+    if (input.currkey < input.bufftop && input.buffer[input.currkey] != '\n') {
+        input.currkey++;
+    }
+    push((Cell)word);
+    push(length);
+}
+
+char *word_string(void) {
+    // the next word as a C string, for words that take a file name; free() it
+    do_word();
+    size_t length = pop();
+    char *word = (char *)pop();
+    char *string = strndup(word, length);
+    if (string == NULL) {
+        forth_error("out of memory");
+    }
+    return string;
+}
+
+// NUMBER. digit_value has what each character is worth as a digit (in any base
+// up to 36, either case), or 255. Base 10 also takes eight digits at a time
+// when it can: test that all eight bytes are '0'-'9' and combine them in pairs,
+// fours and then eights with a few multiplies.
+const uint8_t digit_value[256] = {
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+      0,   1,   2,   3,   4,   5,   6,   7,   8,   9, 255, 255, 255, 255, 255, 255,
+    255,  10,  11,  12,  13,  14,  15,  16,  17,  18,  19,  20,  21,  22,  23,  24,
+     25,  26,  27,  28,  29,  30,  31,  32,  33,  34,  35, 255, 255, 255, 255, 255,
+    255,  10,  11,  12,  13,  14,  15,  16,  17,  18,  19,  20,  21,  22,  23,  24,
+     25,  26,  27,  28,  29,  30,  31,  32,  33,  34,  35, 255, 255, 255, 255, 255,
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+};
+
+#if defined(__GNUC__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+int eight_digits(uint64_t chunk) {
+    // are all of chunk's bytes '0' to '9'? (0x3X, and still 0x3X with 6 added)
+    return ((chunk & 0xF0F0F0F0F0F0F0F0) | (((chunk + 0x0606060606060606) & 0xF0F0F0F0F0F0F0F0) >> 4))
+        == 0x3333333333333333;
+}
+
+uint64_t eight_digits_value(uint64_t chunk) {
+    // the first character is the lowest byte and the most significant digit
+    chunk -= 0x3030303030303030;
+    chunk = chunk * 10 + (chunk >> 8); // pairs of digits, in every other byte
+    return (((chunk & 0x000000FF000000FF) * (100 + (1000000ull << 32)))
+            + (((chunk >> 16) & 0x000000FF000000FF) * (1 + (10000ull << 32)))) >> 32;
+}
+
+// The same for base 16. With the high bits clear, adding 0x80 - lo to a byte
+// sets its high bit if it is >= lo, without carrying into the next one.
+#define BYTES_AT_LEAST(x, lo) (((x) + 0x0101010101010101 * (0x80 - (lo))) & 0x8080808080808080)
+#define HEX_LETTERS(chunk) (BYTES_AT_LEAST((chunk) | 0x2020202020202020, 'a') \
+                            & ~BYTES_AT_LEAST((chunk) | 0x2020202020202020, 'f' + 1))
+
+int eight_hex_digits(uint64_t chunk) {
+    // are all of chunk's bytes '0' to '9', 'A' to 'F' or 'a' to 'f'?
+    if (chunk & 0x8080808080808080) {
+        return 0;
+    }
+    uint64_t digits = BYTES_AT_LEAST(chunk, '0') & ~BYTES_AT_LEAST(chunk, '9' + 1);
+    return (digits | HEX_LETTERS(chunk)) == 0x8080808080808080;
+}
+
+uint64_t eight_hex_digits_value(uint64_t chunk) {
+    // each byte's low 4 bits, plus 9 for letters, then pairs, fours and eights
+    // of them put together with the first character most significant
+    chunk = (chunk & 0x0F0F0F0F0F0F0F0F) + (HEX_LETTERS(chunk) >> 7) * 9;
+    chunk = ((chunk & 0x00FF00FF00FF00FF) << 4) | ((chunk >> 8) & 0x00FF00FF00FF00FF);
+    chunk = ((chunk & 0x0000FFFF0000FFFF) << 8) | ((chunk >> 16) & 0x0000FFFF0000FFFF);
+    return ((chunk & 0xFFFFFFFF) << 16) | (chunk >> 32);
+}
+#endif
 
-    if (negative) {
-        push(-number);
+size_t parse_number(const char *s, size_t length, Cell radix, Cell *value) {
+    // s in radix into *value, as far as it goes; returns how many characters
+    // weren't digits, from the first one that wasn't. Like the rest of the
+    // arithmetic, anything too big for a cell wraps around.
+    size_t i = 0;
+    uintptr_t n = 0;
+    int negative = length > 1 && s[0] == '-'; // only "-" as a number is an error
+    if (length == 0) {
+        // trying to parse a zero-length string is an error, but will return 0.
+        *value = 0;
+        return 1;
+    }
+    i = negative;
+    if (radix == 10) {
+#if defined(__GNUC__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        uint64_t chunk;
+        while (i + 8 <= length && (memcpy(&chunk, s + i, 8), eight_digits(chunk))) {
+            n = n * 100000000 + eight_digits_value(chunk);
+            i += 8;
+        }
+#endif
+        for (; i < length && (unsigned)(s[i] - '0') < 10; i++) {
+            n = n * 10 + (s[i] - '0');
+        }
+    } else if (radix == 16) {
+#if defined(__GNUC__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        uint64_t chunk;
+        while (i + 8 <= length && (memcpy(&chunk, s + i, 8), eight_hex_digits(chunk))) {
+            n = n << 32 | eight_hex_digits_value(chunk);
+            i += 8;
+        }
+#endif
+        for (; i < length && digit_value[(unsigned char)s[i]] < 16; i++) {
+            n = n << 4 | digit_value[(unsigned char)s[i]];
+        }
     } else {
-        push(number);
+        for (; i < length && digit_value[(unsigned char)s[i]] < radix; i++) {
+            n = n * radix + digit_value[(unsigned char)s[i]];
+        }
     }
+    *value = negative ? (Cell)-n : (Cell)n;
+    return length - i;
+}
+
+void do_number(void) {
+    // ( addr length -- n unparsed ), unparsed is 0 if it was all a number
+    size_t length = pop();
+    char *s = (char *)pop();
+    Cell number;
+    size_t unparsed = parse_number(s, length, base, &number);
+    push(number);
     push(unparsed);
+    if (unparsed == 0) {
+        STAT(numbers);
+    }
+}
+
+void do_parse_numbers(void) {
+    // PARSE-NUMBERS ( addr length dst -- count ) the whitespace separated
+    // numbers in the string, into cells from dst on, up to the first thing
+    // that isn't a number
+    Cell *dst = (Cell *)pop();
+    size_t length = pop();
+    char *s = (char *)pop();
+    size_t i = 0, count = 0;
+    while (1) {
+        i += scan_bytes(s + i, length - i, 0);
+        if (i == length) break;
+        size_t end = i + scan_bytes(s + i, length - i, 1);
+        Cell n;
+        if (parse_number(s + i, end - i, base, &n) != 0) break;
+        dst[count++] = n;
+        i = end;
+    }
+    push(count);
 }
 
 Word word_key    = { NULL, 0, "KEY",    do_key,    NULL };
 Word word_emit   = { NULL, 0, "EMIT",   do_emit,   NULL };
+Word word_tell   = { NULL, 0, "TELL",   do_tell,   NULL };
 Word word_word   = { NULL, 0, "WORD",   do_word,   NULL };
 Word word_number = { NULL, 0, "NUMBER", do_number, NULL };
+Word word_parse_numbers = { NULL, 0, "PARSE-NUMBERS", do_parse_numbers, NULL };
+
+// FIND index. Every word in the latest list is also in a bucket of this hash
+// table (chained through hash_link), keyed on the name folded to lower case.
+// Buckets are kept newest first just like the linked list, so walking a bucket
+// finds the same word the linear walk would: the newest definition wins, and
+// hidden words are skipped at lookup time, which is why HIDDEN doesn't have to
+// touch the index when it toggles F_HIDDEN.
+#define DICT_HASH_MIN 256
+Word **dict_hash = NULL;
+size_t dict_hash_size = 0;  // number of buckets, always a power of 2
+size_t dict_hash_count = 0; // number of words in the table
+Word *dict_hash_latest = NULL; // value of latest the table was last updated for
+
+size_t name_hash(const char *name, size_t length) {
+    // FNV-1a on the lower case name
+    size_t h = 14695981039346656037u;
+    for (size_t i = 0; i < length; i++) {
+        h ^= (unsigned char)tolower((unsigned char)name[i]);
+        h *= 1099511628211u;
+    }
+    return h;
+}
 
-void do_find(void) {
-    int length = pop(); // not used, we use a struct with a pointer to a null terminated name
-    char *name = (char *)pop();
+void dict_hash_rebuild(size_t size) {
+    // rebuild the whole table from the latest list, e.g. when it needs to grow or
+    // when LATEST was changed behind our back.
+    // Words are appended to the end of their bucket while walking newest to oldest.
+    Word **table = calloc(size, sizeof(Word *));
+    Word **tails = calloc(size, sizeof(Word *));
+    if (!table || !tails) {
+        // keep using the old table (or none), lookups are still correct just slower
+        free(table);
+        free(tails);
+        return;
+    }
+    size_t count = 0;
     for (Word *w = latest; w != NULL; w = w->link) {
-        if (strcasecmp(w->name, name) == 0 && !(w->flags & F_HIDDEN)) {
-            push((Cell)w);
-            return;
+        size_t b = name_hash(w->name, strlen(w->name)) & (size - 1);
+        w->hash_link = NULL;
+        if (tails[b]) {
+            tails[b]->hash_link = w;
+        } else {
+            table[b] = w;
+        }
+        tails[b] = w;
+        count++;
+    }
+    free(tails);
+    free(dict_hash);
+    dict_hash = table;
+    dict_hash_size = size;
+    dict_hash_count = count;
+    dict_hash_latest = latest;
+}
+
+void dict_hash_add(Word *w) {
+    // called after w has become latest
+    if (dict_hash == NULL || w->link != dict_hash_latest || dict_hash_count >= dict_hash_size) {
+        size_t size = dict_hash_size ? dict_hash_size : DICT_HASH_MIN;
+        while (size <= dict_hash_count) {
+            size *= 2;
+        }
+        // w is latest, so the new table has it; if there's no memory for one,
+        // dict_lookup() sees dict_hash_latest != latest and tries again
+        dict_hash_rebuild(size);
+        return;
+    }
+    size_t b = name_hash(w->name, strlen(w->name)) & (dict_hash_size - 1);
+    w->hash_link = dict_hash[b];
+    dict_hash[b] = w;
+    dict_hash_count++;
+    dict_hash_latest = w;
+}
+
+int dict_has(Word *w) {
+    // is w one of the words in the dictionary (hidden or not)?
+    if (dict_hash_latest != latest || dict_hash == NULL) {
+        dict_hash_rebuild(dict_hash_size ? dict_hash_size : DICT_HASH_MIN);
+    }
+    if (dict_hash == NULL) {
+        for (Word *x = latest; x != NULL; x = x->link) {
+            if (x == w) return 1;
+        }
+        return 0;
+    }
+    size_t b = name_hash(w->name, strlen(w->name)) & (dict_hash_size - 1);
+    for (Word *x = dict_hash[b]; x != NULL; x = x->hash_link) {
+        if (x == w) return 1;
+    }
+    return 0;
+}
+
+Word *dict_lookup(const char *name, size_t length, Cell skip_flags) {
+    // newest word called name (any case) that has none of skip_flags set
+    if (dict_hash_latest != latest || dict_hash == NULL) {
+        // somebody stored to LATEST directly
+        dict_hash_rebuild(dict_hash_size ? dict_hash_size : DICT_HASH_MIN);
+    }
+    if (dict_hash == NULL) {
+        // out of memory for the table, fall back to walking the list
+        for (Word *w = latest; w != NULL; w = w->link) {
+            if (strncasecmp(w->name, name, length) == 0 && w->name[length] == '\0'
+                    && !(w->flags & skip_flags)) {
+                return w;
+            }
+        }
+        return NULL;
+    }
+    Word *w = dict_hash[name_hash(name, length) & (dict_hash_size - 1)];
+    for (; w != NULL; w = w->hash_link) {
+        if (strncasecmp(w->name, name, length) == 0 && w->name[length] == '\0'
+                && !(w->flags & skip_flags)) {
+            return w;
+        }
+    }
+    return NULL;
+}
+
+void forget_since(void *mark, char *data_mark) {
+    // drop every word defined at or after mark in the dictionary, keeping
+    // built in words added since (linked past the dropped ones), and move here
+    // and data_here back
+    for (Word **link = &latest; *link != NULL; ) {
+        if (in_dictionary(*link) && (char *)*link >= (char *)mark) {
+            *link = (*link)->link;
+        } else {
+            link = &(*link)->link;
         }
     }
-    push((Cell)NULL);
-    return;
+#if PROFILE
+    // and PROFILE-REPORT mustn't look at them either
+    size_t kept = 0;
+    for (size_t i = 0; i < prof_nseen; i++) {
+        if (!in_dictionary(prof_seen[i]) || (char *)prof_seen[i] < (char *)mark) {
+            prof_seen[kept++] = prof_seen[i];
+        }
+    }
+    prof_nseen = kept;
+#endif
+    here = mark;
+    data_here = data_mark;
+    dict_hash_rebuild(dict_hash_size ? dict_hash_size : DICT_HASH_MIN);
+}
+
+void do_find(void) {
+    int length = pop();
+    char *name = (char *)pop();
+    Word *w = dict_lookup(name, length, F_HIDDEN);
+    STAT(find_calls);
+    if (w == NULL) {
+        STAT(find_misses);
+    }
+    push((Cell)w);
 }
 
 void do_tcfa(void) {
@@ -706,9 +2059,17 @@ void do_tdfa(void) {
     push((Cell)w->params); // void *params in Word struct (pointer to a code body outside the struct)
 }
 
+void dict_room(size_t bytes) {
+    // make sure there's room for bytes more at here, before writing anything
+    if (bytes > (size_t)(dictionary + dictionary_size - (char *)here)) {
+        forth_error("dictionary full");
+    }
+}
+
 void do_create(void) {
     int length = pop();
     char *name = (char *)pop();
+    dict_room(sizeof(Word) + length + 1 + BODY_ALIGN);
 	// Link pointer.
     Word *new_word = (Word *)here;
     here += sizeof(Word);
@@ -717,16 +2078,59 @@ void do_create(void) {
     new_word->flags = 0;
     new_word->name = here;
     strncpy((char *)here, name, length);
+    ((char *)here)[length] = '\0';
     here += length + 1;
+    here = (void *)(((uintptr_t)here + BODY_ALIGN - 1) & -(uintptr_t)BODY_ALIGN);
     new_word->code = docol;
     new_word->params = here; // it is expected compilation will come next
+#if THREADED_GOTO
+    new_word->op = 0;
+#endif
+#if PROFILE
+    // here might have been moved back over a forgotten word
+    new_word->prof_count = new_word->prof_self = new_word->prof_total = new_word->prof_active = 0;
+#endif
+    dict_hash_add(new_word);
 }
 
 void do_comma(void) {
+    dict_room(sizeof(Cell));
     *((Cell *)here) = (Cell)pop();
     here += sizeof(Cell);
 }
 
+void do_allot(void) {
+    // ( n -- addr ) like JonesForth's, but from the data space, and cell aligned
+    Cell n = pop();
+    char *addr = (char *)(((uintptr_t)data_here + sizeof(Cell) - 1) & -(uintptr_t)sizeof(Cell));
+    if (n > data_space + data_space_size - addr) {
+        forth_error("data space full");
+    }
+    if (n < data_space - addr) {
+        forth_error("ALLOT before the start of the data space");
+    }
+    data_here = addr + n;
+    push((Cell)addr);
+}
+
+void do_dovar(void) {
+    // what a VARIABLE runs: its cell is in the data space, params points at it
+    push((Cell)current_word->params);
+}
+
+void do_variable(void) {
+    // VARIABLE name
+    do_word();
+    do_create();
+    push(sizeof(Cell));
+    do_allot();
+    latest->params = (void *)pop();
+    *(Cell *)latest->params = 0;
+    latest->code = do_dovar;
+    // no body, so give back the padding up to the cache line
+    here = (void *)(((uintptr_t)latest->name + strlen(latest->name) + sizeof(Cell)) & -(uintptr_t)sizeof(Cell));
+}
+
 void do_lbrac(void) {
     // [
     state = 0; // immediate mode
@@ -741,8 +2145,18 @@ void do_immediate(void) {
     latest->flags ^= F_IMMED; // toggle the immediate bit
 }
 
+void do_inline(void) {
+    latest->flags ^= F_INLINE; // toggle the inline bit
+}
+
+void do_noinline(void) {
+    latest->flags ^= F_NOINLINE; // toggle the noinline bit
+}
+
 void do_hidden(void) {
-    latest->flags ^= F_HIDDEN; // toggle the hidden bit
+    // ( word -- ) like JonesForth, so HIDE can hide any word and not just latest
+    Word *w = (Word *)pop();
+    w->flags ^= F_HIDDEN; // toggle the hidden bit
 }
 
 Word word_find      = { NULL, 0,       "FIND",      do_find,      NULL };
@@ -750,9 +2164,13 @@ Word word_tcfa      = { NULL, 0,       ">CFA",      do_tcfa,      NULL };
 Word word_tdfa      = { NULL, 0,       ">DFA",      do_tdfa,      NULL };
 Word word_create    = { NULL, 0,       "CREATE",    do_create,    NULL };
 Word word_comma     = { NULL, 0,       ",",         do_comma,     NULL };
+Word word_allot     = { NULL, 0,       "ALLOT",     do_allot,     NULL };
+Word word_variable  = { NULL, 0,       "VARIABLE",  do_variable,  NULL };
 Word word_lbrac     = { NULL, F_IMMED, "[",         do_lbrac,     NULL };
 Word word_rbrac     = { NULL, 0,       "]",         do_rbrac,     NULL };
 Word word_immediate = { NULL, F_IMMED, "IMMEDIATE", do_immediate, NULL };
+Word word_inline    = { NULL, F_IMMED, "INLINE",    do_inline,    NULL };
+Word word_noinline  = { NULL, F_IMMED, "NOINLINE",  do_noinline,  NULL };
 Word word_hidden    = { NULL, 0,       "HIDDEN",    do_hidden,    NULL };
 
 Word *colon_body[] = {
@@ -767,8 +2185,14 @@ Word word_colon  = { NULL, 0, ":", docol, colon_body };
 Word *hide_body[] = { &word_word, &word_find, &word_hidden, &word_exit };
 Word word_hide = { NULL, 0, "HIDE", docol, hide_body };
 
+void do_optimize(void); // below, it needs the branch words
+
+// OPTIMIZE rewrites the body of the word being defined in place, ; calls it once EXIT is appended
+Word word_optimize = { NULL, 0, "OPTIMIZE", do_optimize, NULL };
+
 Word *semicolon_body[] = {
     &word_lit, &word_exit, &word_comma, // Append EXIT (so the word will return).
+    &word_optimize, // Tidy up the code body.
     &word_var_latest, &word_fetch, &word_hidden, // Toggle hidden flag -- unhide the word.
     &word_lbrac, // Go back to IMMEDIATE mode.
     &word_exit // Return from the function.
@@ -800,133 +2224,2755 @@ void do_zbranch(void) {
     }
 }
 
-Word word_branch  = { NULL, 0, "BRANCH",  do_branch,  NULL };
-Word word_zbranch = { NULL, 0, "0BRANCH", do_zbranch, NULL };
-
-// Note: built in words don't live in the actual dictionary / user data space
-void add_word(Word *w) {
-    w->link = latest;
-    latest = w;
+Word word_branch  = { NULL, 0, "BRANCH",  do_branch,  NULL };
+Word word_zbranch = { NULL, 0, "0BRANCH", do_zbranch, NULL };
+
+// superinstructions, only ever compiled by OPTIMIZE
+
+void do_litadd(void) {
+    // LIT n +
+    sp[0] += *ip++;
+}
+
+void do_litequ(void) {
+    // LIT n =
+    sp[0] = (sp[0] == *ip++);
+}
+
+void do_dupadd(void) {
+    // DUP +
+    sp[0] += sp[0];
+}
+
+// comparison followed by 0BRANCH, the branch is taken when the comparison is false
+void do_equ_zbranch(void) {
+    Cell a = pop();
+    Cell b = pop();
+    if (b == a) ip++; else ip += *ip;
+}
+
+void do_nequ_zbranch(void) {
+    Cell a = pop();
+    Cell b = pop();
+    if (b != a) ip++; else ip += *ip;
+}
+
+void do_lt_zbranch(void) {
+    Cell a = pop();
+    Cell b = pop();
+    if (b < a) ip++; else ip += *ip;
+}
+
+void do_gt_zbranch(void) {
+    Cell a = pop();
+    Cell b = pop();
+    if (b > a) ip++; else ip += *ip;
+}
+
+void do_le_zbranch(void) {
+    Cell a = pop();
+    Cell b = pop();
+    if (b <= a) ip++; else ip += *ip;
+}
+
+void do_ge_zbranch(void) {
+    Cell a = pop();
+    Cell b = pop();
+    if (b >= a) ip++; else ip += *ip;
+}
+
+void do_zequ_zbranch(void) {
+    // 0= 0BRANCH, i.e. branch if not zero
+    if (pop() == 0) ip++; else ip += *ip;
+}
+
+void do_tailcall(void) {
+    // TAILCALL word, the same as "word EXIT" but without the return stack round trip
+    Word *w = (Word *)*ip;
+    ip = (Cell *)w->params;
+#if PROFILE
+    prof_leave();
+    prof_enter(w);
+#endif
+}
+
+Word word_litadd        = { NULL, 0, "LIT+",       do_litadd,       NULL };
+Word word_litequ        = { NULL, 0, "LIT=",       do_litequ,       NULL };
+Word word_dupadd        = { NULL, 0, "DUP+",       do_dupadd,       NULL };
+Word word_equ_zbranch   = { NULL, 0, "=0BRANCH",   do_equ_zbranch,  NULL };
+Word word_nequ_zbranch  = { NULL, 0, "<>0BRANCH",  do_nequ_zbranch, NULL };
+Word word_lt_zbranch    = { NULL, 0, "<0BRANCH",   do_lt_zbranch,   NULL };
+Word word_gt_zbranch    = { NULL, 0, ">0BRANCH",   do_gt_zbranch,   NULL };
+Word word_le_zbranch    = { NULL, 0, "<=0BRANCH",  do_le_zbranch,   NULL };
+Word word_ge_zbranch    = { NULL, 0, ">=0BRANCH",  do_ge_zbranch,   NULL };
+Word word_zequ_zbranch  = { NULL, 0, "0=0BRANCH",  do_zequ_zbranch, NULL };
+Word word_tailcall      = { NULL, 0, "TAILCALL",   do_tailcall,     NULL };
+
+// words that are never add_word()ed but turn up in compiled code
+Word *hidden_words[] = {
+    &word_lit, &word_litadd, &word_litequ, &word_dupadd,
+    &word_equ_zbranch, &word_nequ_zbranch, &word_lt_zbranch, &word_gt_zbranch,
+    &word_le_zbranch, &word_ge_zbranch, &word_zequ_zbranch, &word_tailcall,
+};
+
+int is_branch(Word *w) {
+    // words followed by an ip relative offset
+    return w == &word_branch || w == &word_zbranch
+        || w == &word_equ_zbranch || w == &word_nequ_zbranch
+        || w == &word_lt_zbranch || w == &word_gt_zbranch
+        || w == &word_le_zbranch || w == &word_ge_zbranch
+        || w == &word_zequ_zbranch;
+}
+
+int operand_cells(Word *w) {
+    // how many cells after w in a code body are data rather than words
+    if (is_branch(w) || w == &word_lit || w == &word_tick
+            || w == &word_litadd || w == &word_litequ || w == &word_tailcall) {
+        return 1;
+    }
+    return 0;
+}
+
+Word *fused_zbranch(Word *w) {
+    // superinstruction for "w 0BRANCH", or NULL
+    if (w == &word_equ)   return &word_equ_zbranch;
+    if (w == &word_nequ)  return &word_nequ_zbranch;
+    if (w == &word_lt)    return &word_lt_zbranch;
+    if (w == &word_gt)    return &word_gt_zbranch;
+    if (w == &word_le)    return &word_le_zbranch;
+    if (w == &word_ge)    return &word_ge_zbranch;
+    if (w == &word_zequ)  return &word_zequ_zbranch;
+    if (w == &word_znequ) return &word_zbranch; // 0<> doesn't change what 0BRANCH does
+    return NULL;
+}
+
+// every word add_word() has registered, so is_colon_word() doesn't have to walk
+// the whole dictionary to find out if something is one of them
+Word **builtin_words = NULL;
+size_t nbuiltin_words = 0;
+
+int is_word(Word *w) {
+    // only follow pointers we know are words, a body can have anything , into it
+    if (in_dictionary(w)) {
+        // CREATE puts the name straight after the header, so that much is
+        // safe to look at, and then it's a word if it's in its hash bucket
+        return w->name == (char *)(w + 1) && dict_has(w);
+    }
+    for (size_t i = 0; i < nbuiltin_words; i++) {
+        if (builtin_words[i] == w) {
+            return 1;
+        }
+    }
+    for (size_t i = 0; i < sizeof(hidden_words) / sizeof(hidden_words[0]); i++) {
+        if (hidden_words[i] == w) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int is_colon_word(Word *w) {
+    return is_word(w) && is_docol(w);
+}
+
+int is_return_stack_word(Word *x) {
+    return x == &word_tor || x == &word_fromr || x == &word_rdrop
+        || x == &word_rspfetch || x == &word_rspstore;
+}
+
+int uses_return_stack(Word *w) {
+    // does colon word w play with the return stack anywhere before the EXIT
+    // that ends it? (if its body has something that isn't a word, assume so)
+    Cell *body = (Cell *)w->params;
+    Cell furthest = 0; // furthest branch target seen
+    for (Cell i = 0; ; i += 1 + operand_cells((Word *)body[i])) {
+        Word *x = (Word *)body[i];
+        if (!is_word(x) || is_return_stack_word(x)) {
+            return 1;
+        }
+        if (is_branch(x) && i + 1 + body[i + 1] > furthest) {
+            furthest = i + 1 + body[i + 1];
+        }
+        if (x == &word_exit && i >= furthest) {
+            return 0;
+        }
+    }
+}
+
+void peephole(Cell *body, Cell *end) {
+    // Rewrite the code body from body up to end:
+    // - fuse common pairs into superinstructions (PEEPHOLE)
+    // - turn "word EXIT" into "TAILCALL word EXIT" for colon words (TAIL_CALLS),
+    //   the EXIT stays where it was in case something branches to it
+    // Branch offsets are fixed up as the body changes size and here is moved to
+    // the new end. Nothing is fused across a branch target, and if the body doesn't
+    // decode cleanly (a branch into the middle of an instruction) it is left alone.
+    size_t n = end - body;
+    char *target = calloc(n + 1, 1);            // old cell is jumped to
+    Cell *out = malloc(2 * n * sizeof(Cell));   // new body, at worst every call gets a TAILCALL
+    Cell *map = malloc((n + 1) * sizeof(Cell)); // old cell -> new cell, -1 if not an instruction
+    Cell *fixups = malloc(n * sizeof(Cell));    // new cells holding a branch offset
+    Cell *old_targets = malloc(n * sizeof(Cell));
+    size_t nfixups = 0;
+    int changed = 0;
+    if (!target || !out || !map || !fixups || !old_targets) goto done;
+
+    for (size_t i = 0; i < n; i += 1 + operand_cells((Word *)body[i])) {
+        Word *w = (Word *)body[i];
+        if (is_branch(w) && i + 1 < n) {
+            Cell t = i + 1 + body[i + 1];
+            if (t < 0 || t > (Cell)n) goto done; // jumps out of the body, don't touch it
+            target[t] = 1;
+        }
+    }
+
+    size_t i = 0, j = 0;
+    for (size_t k = 0; k <= n; k++) map[k] = -1;
+    while (i < n) {
+        Word *w = (Word *)body[i];
+        Word *next = i + 1 < n ? (Word *)body[i + 1] : NULL;
+        Word *after = i + 2 < n ? (Word *)body[i + 2] : NULL;
+        map[i] = j;
+        if (PEEPHOLE && w == &word_lit && (after == &word_add || after == &word_equ) && !target[i + 2]) {
+            out[j++] = (Cell)(after == &word_add ? &word_litadd : &word_litequ);
+            out[j++] = body[i + 1];
+            i += 3;
+            changed = 1;
+        } else if (PEEPHOLE && w == &word_dup && next == &word_add && !target[i + 1]) {
+            out[j++] = (Cell)&word_dupadd;
+            i += 2;
+            changed = 1;
+        } else if (PEEPHOLE && w == &word_over && next == &word_over && !target[i + 1]) {
+            out[j++] = (Cell)&word_twodup;
+            i += 2;
+            changed = 1;
+        } else if (PEEPHOLE && w == &word_fromr && next == &word_drop && !target[i + 1]) {
+            out[j++] = (Cell)&word_rdrop;
+            i += 2;
+            changed = 1;
+        } else if (PEEPHOLE && fused_zbranch(w) && next == &word_zbranch && !target[i + 1] && i + 2 < n) {
+            out[j++] = (Cell)fused_zbranch(w);
+            fixups[nfixups] = j;
+            old_targets[nfixups++] = i + 2 + body[i + 2];
+            out[j++] = 0;
+            i += 3;
+            changed = 1;
+        } else if (TAIL_CALLS && next == &word_exit && is_colon_word(w) && !uses_return_stack(w)) {
+            // (a word that pops its return address would pop the wrong one)
+            out[j++] = (Cell)&word_tailcall;
+            out[j++] = (Cell)w;
+            i += 1; // the EXIT gets copied (and mapped) next time round
+            changed = 1;
+        } else {
+            // copy as is
+            out[j++] = body[i++];
+            for (int k = operand_cells(w); k > 0 && i < n; k--) {
+                if (is_branch(w)) {
+                    fixups[nfixups] = j;
+                    old_targets[nfixups++] = i + body[i];
+                }
+                out[j++] = body[i++];
+            }
+        }
+    }
+    map[n] = j;
+    if (!changed) goto done;
+
+    for (size_t k = 0; k < nfixups; k++) {
+        Cell t = map[old_targets[k]];
+        if (t < 0) goto done;
+        out[fixups[k]] = t - fixups[k];
+    }
+    memcpy(body, out, j * sizeof(Cell));
+    here = body + j;
+
+done:
+    free(target);
+    free(out);
+    free(map);
+    free(fixups);
+    free(old_targets);
+}
+
+#if JIT
+int jit_compile(Word *w, Cell *end); // below, it needs run()
+#endif
+
+void do_optimize(void) {
+    // OPTIMIZE the body of latest, which runs up to here
+#if PEEPHOLE || TAIL_CALLS
+    if (latest->code == docol) {
+        peephole((Cell *)latest->params, (Cell *)here);
+    }
+#endif
+#if JIT
+    if (latest->code == docol) {
+        jit_compile(latest, (Cell *)here);
+    }
+#endif
+}
+
+// ( n -- n+(n-1)+...+1 ) built-in loop so BRANCH/0BRANCH get exercised by the tests
+Word *triangle_body[] = {
+    &word_lit, (void *)0, &word_swap,            // ( acc n )
+    &word_dup, &word_zbranch, (void *)8,         // 3: while n is non-zero
+    &word_dup, &word_rot, &word_add, &word_swap, //    acc += n
+    &word_decr,                                  //    n--
+    &word_branch, (void *)-9,                    //    back to 3
+    &word_drop, &word_exit                       // 13: ( acc )
+};
+Word word_triangle = { NULL, 0, "TRIANGLE", docol, triangle_body };
+
+// Note: built in words don't live in the actual dictionary / user data space
+void add_word(Word *w) {
+    w->link = latest;
+    latest = w;
+    dict_hash_add(w);
+    Word **more = realloc(builtin_words, (nbuiltin_words + 1) * sizeof(Word *));
+    if (more) {
+        builtin_words = more;
+        builtin_words[nbuiltin_words++] = w;
+    }
+}
+
+#if PROFILE
+void prof_dispatch(Word *w) {
+    // run w, timing it if it is a primitive; colon words are timed from docol
+    // (or run()) to EXIT, and TAILCALL swaps one frame for another
+    if (w->code == docol || w == &word_exit || w == &word_tailcall) {
+        w->code();
+        return;
+    }
+    uint64_t start = prof_now();
+    w->code();
+    uint64_t total = prof_now() - start;
+    prof_account(w, total, total);
+}
+
+int prof_cmp(const void *a, const void *b) {
+    // most self time first
+    uint64_t x = (*(Word **)a)->prof_self;
+    uint64_t y = (*(Word **)b)->prof_self;
+    return (x < y) - (x > y);
+}
+
+void do_profile_report(void) {
+    // PROFILE-REPORT ( n -- ), print the n words that took the most time
+    Cell n = pop();
+    uint64_t all = 0;
+    for (size_t i = 0; i < prof_nseen; i++) {
+        all += prof_seen[i]->prof_self;
+    }
+    qsort(prof_seen, prof_nseen, sizeof(Word *), prof_cmp);
+#if defined(__x86_64__) || defined(__i386__)
+    const char *unit = "cycles";
+#else
+    const char *unit = "ns";
+#endif
+    output_printf("%6s %14s %14s %12s  word (times in %s)\n", "self%", "self", "total", "count", unit);
+    for (size_t i = 0; i < prof_nseen && (Cell)i < n; i++) {
+        Word *w = prof_seen[i];
+        output_printf("%6.2f %14llu %14llu %12llu  %s\n", all ? 100.0 * w->prof_self / all : 0.0,
+               (unsigned long long)w->prof_self, (unsigned long long)w->prof_total,
+               (unsigned long long)w->prof_count, w->name ? w->name : "?");
+    }
+}
+
+Word word_profile_report = { NULL, 0, "PROFILE-REPORT", do_profile_report, NULL };
+#endif
+
+#if !THREADED_GOTO
+void run(Word *start) {
+    // push NULL (current IP which is initially NULL or NULL itself?)
+    // docol only pushes what we set ip to here which is the next word
+    // in the params we're running
+    rp--;
+    *rp = (Cell)ip;
+    ip = (Cell *)start->params;
+    STAT(docol);
+#if PROFILE
+    prof_enter(start);
+#endif
+    while (ip != NULL) {
+        current_word = (Word *)*ip;
+        ip++;
+#if STATS >= 2
+        STAT(dispatched);
+#endif
+#if PROFILE
+        prof_dispatch(current_word);
+#else
+        current_word->code();
+#endif
+    }
+}
+#else
+// Same job as the loop above, but instead of an indirect call per instruction
+// every primitive listed in goto_ops has its body copied in here behind a label,
+// and each one ends by fetching the next Word and jumping straight to its label.
+// ip, sp and rp live in locals so the compiler can keep them in registers; they
+// are only written back to the globals around words that still go through their
+// C function (op_call), since those work on the globals.
+// Threaded code still holds Word pointers (so ' , FIND >DFA and ; don't change),
+// the label to jump to comes from Word.op.
+enum {
+    OP_RESOLVE, OP_CALL, OP_DOCOL, OP_EXIT, OP_LIT, OP_TICK, OP_BRANCH, OP_ZBRANCH,
+    OP_DROP, OP_SWAP, OP_DUP, OP_OVER, OP_ROT, OP_NROT,
+    OP_TWODROP, OP_TWODUP, OP_TWOSWAP, OP_QDUP,
+    OP_INCR, OP_DECR, OP_INCR8, OP_DECR8,
+    OP_ADD, OP_SUB, OP_MUL, OP_DIV, OP_MOD, OP_DIVMOD,
+    OP_EQU, OP_NEQU, OP_LT, OP_GT, OP_LE, OP_GE,
+    OP_ZEQU, OP_ZNEQU, OP_ZLT, OP_ZGT, OP_ZLE, OP_ZGE,
+    OP_AND, OP_OR, OP_XOR, OP_INVERT,
+    OP_STORE, OP_FETCH, OP_ADDSTORE, OP_SUBSTORE, OP_STOREBYTE, OP_FETCHBYTE,
+    OP_TOR, OP_FROMR, OP_RDROP,
+    OP_LITADD, OP_LITEQU, OP_DUPADD,
+    OP_EQU_ZBRANCH, OP_NEQU_ZBRANCH, OP_LT_ZBRANCH, OP_GT_ZBRANCH,
+    OP_LE_ZBRANCH, OP_GE_ZBRANCH, OP_ZEQU_ZBRANCH, OP_TAILCALL,
+    OP_COUNT
+};
+
+struct { CodeFn code; Cell op; } goto_ops[] = {
+    { docol,      OP_DOCOL },     { do_exit,      OP_EXIT },
+    { do_lit,     OP_LIT },       { do_tick,      OP_TICK },
+    { do_branch,  OP_BRANCH },    { do_zbranch,   OP_ZBRANCH },
+    { do_drop,    OP_DROP },      { do_swap,      OP_SWAP },
+    { do_dup,     OP_DUP },       { do_over,      OP_OVER },
+    { do_rot,     OP_ROT },       { do_nrot,      OP_NROT },
+    { do_twodrop, OP_TWODROP },   { do_twodup,    OP_TWODUP },
+    { do_twoswap, OP_TWOSWAP },   { do_qdup,      OP_QDUP },
+    { do_incr,    OP_INCR },      { do_decr,      OP_DECR },
+    { do_incr8,   OP_INCR8 },     { do_decr8,     OP_DECR8 },
+    { do_add,     OP_ADD },       { do_sub,       OP_SUB },
+    { do_mul,     OP_MUL },       { do_div,       OP_DIV },
+    { do_mod,     OP_MOD },       { do_divmod,    OP_DIVMOD },
+    { do_equ,     OP_EQU },       { do_nequ,      OP_NEQU },
+    { do_lt,      OP_LT },        { do_gt,        OP_GT },
+    { do_le,      OP_LE },        { do_ge,        OP_GE },
+    { do_zequ,    OP_ZEQU },      { do_znequ,     OP_ZNEQU },
+    { do_zlt,     OP_ZLT },       { do_zgt,       OP_ZGT },
+    { do_zle,     OP_ZLE },       { do_zge,       OP_ZGE },
+    { do_and,     OP_AND },       { do_or,        OP_OR },
+    { do_xor,     OP_XOR },       { do_invert,    OP_INVERT },
+    { do_store,   OP_STORE },     { do_fetch,     OP_FETCH },
+    { do_addstore, OP_ADDSTORE }, { do_substore,  OP_SUBSTORE },
+    { do_storebyte, OP_STOREBYTE }, { do_fetchbyte, OP_FETCHBYTE },
+    { do_tor,     OP_TOR },       { do_fromr,     OP_FROMR },
+    { do_rdrop,   OP_RDROP },
+    { do_litadd,  OP_LITADD },    { do_litequ,    OP_LITEQU },
+    { do_dupadd,  OP_DUPADD },
+    { do_equ_zbranch, OP_EQU_ZBRANCH }, { do_nequ_zbranch, OP_NEQU_ZBRANCH },
+    { do_lt_zbranch,  OP_LT_ZBRANCH },  { do_gt_zbranch,   OP_GT_ZBRANCH },
+    { do_le_zbranch,  OP_LE_ZBRANCH },  { do_ge_zbranch,   OP_GE_ZBRANCH },
+    { do_zequ_zbranch, OP_ZEQU_ZBRANCH }, { do_tailcall, OP_TAILCALL },
+};
+
+Cell resolve_op(CodeFn code) {
+    // anything without an inline copy just gets its C function called
+    for (size_t i = 0; i < sizeof(goto_ops) / sizeof(goto_ops[0]); i++) {
+        if (goto_ops[i].code == code) {
+            return goto_ops[i].op;
+        }
+    }
+    return OP_CALL;
+}
+
+// stack access for the inline primitives
+#if TOS_CACHE
+// the top of the stack is in tos, vsp[0] is the item under it
+#define TOS      tos
+#define DEEP(n)  vsp[(n) - 1] // n-th item below the top, DEEP(1) is the next one down
+#define DROP1()  (tos = *vsp++)
+#define PUSH1(x) (*--vsp = tos, tos = (x))
+
+// spill tos so sp points at an exact image of the stack, and reload it after
+#define SYNC_OUT() (*--vsp = tos, sp = vsp, rp = vrp, ip = vip, STATS_OUT())
+#define SYNC_IN()  (vsp = sp, vrp = rp, vip = ip, tos = *vsp++)
+#else
+// vsp[0] is the top of the stack
+#define TOS      vsp[0]
+#define DEEP(n)  vsp[n]       // n-th item below the top, DEEP(1) is the next one down
+#define DROP1()  (vsp++)
+#define PUSH1(x) (*--vsp = (x))
+
+#define SYNC_OUT() (sp = vsp, rp = vrp, ip = vip, STATS_OUT())
+#define SYNC_IN()  (vsp = sp, vrp = rp, vip = ip)
+#endif
+// counters are kept in locals too, they go into stats with the registers
+#if STATS >= 2
+#define STATS_OUT() (stats.docol += vdocol, vdocol = 0, stats.dispatched += vdispatched, vdispatched = 0)
+#define NEXT()     do { vdispatched++; w = (Word *)*vip++; goto *labels[w->op]; } while (0)
+#elif STATS
+#define STATS_OUT() (stats.docol += vdocol, vdocol = 0)
+#define NEXT()     do { w = (Word *)*vip++; goto *labels[w->op]; } while (0)
+#else
+#define STATS_OUT() ((void)0)
+#define NEXT()     do { w = (Word *)*vip++; goto *labels[w->op]; } while (0)
+#endif
+
+void run(Word *start) {
+    static void *labels[OP_COUNT] = {
+        [OP_RESOLVE] = &&op_resolve, [OP_CALL] = &&op_call,
+        [OP_DOCOL] = &&op_docol, [OP_EXIT] = &&op_exit,
+        [OP_LIT] = &&op_lit, [OP_TICK] = &&op_lit,
+        [OP_BRANCH] = &&op_branch, [OP_ZBRANCH] = &&op_zbranch,
+        [OP_DROP] = &&op_drop, [OP_SWAP] = &&op_swap, [OP_DUP] = &&op_dup,
+        [OP_OVER] = &&op_over, [OP_ROT] = &&op_rot, [OP_NROT] = &&op_nrot,
+        [OP_TWODROP] = &&op_twodrop, [OP_TWODUP] = &&op_twodup,
+        [OP_TWOSWAP] = &&op_twoswap, [OP_QDUP] = &&op_qdup,
+        [OP_INCR] = &&op_incr, [OP_DECR] = &&op_decr,
+        [OP_INCR8] = &&op_incr8, [OP_DECR8] = &&op_decr8,
+        [OP_ADD] = &&op_add, [OP_SUB] = &&op_sub, [OP_MUL] = &&op_mul,
+        [OP_DIV] = &&op_div, [OP_MOD] = &&op_mod, [OP_DIVMOD] = &&op_divmod,
+        [OP_EQU] = &&op_equ, [OP_NEQU] = &&op_nequ, [OP_LT] = &&op_lt,
+        [OP_GT] = &&op_gt, [OP_LE] = &&op_le, [OP_GE] = &&op_ge,
+        [OP_ZEQU] = &&op_zequ, [OP_ZNEQU] = &&op_znequ, [OP_ZLT] = &&op_zlt,
+        [OP_ZGT] = &&op_zgt, [OP_ZLE] = &&op_zle, [OP_ZGE] = &&op_zge,
+        [OP_AND] = &&op_and, [OP_OR] = &&op_or, [OP_XOR] = &&op_xor,
+        [OP_INVERT] = &&op_invert,
+        [OP_STORE] = &&op_store, [OP_FETCH] = &&op_fetch,
+        [OP_ADDSTORE] = &&op_addstore, [OP_SUBSTORE] = &&op_substore,
+        [OP_STOREBYTE] = &&op_storebyte, [OP_FETCHBYTE] = &&op_fetchbyte,
+        [OP_TOR] = &&op_tor, [OP_FROMR] = &&op_fromr, [OP_RDROP] = &&op_rdrop,
+        [OP_LITADD] = &&op_litadd, [OP_LITEQU] = &&op_litequ, [OP_DUPADD] = &&op_dupadd,
+        [OP_EQU_ZBRANCH] = &&op_equ_zbranch, [OP_NEQU_ZBRANCH] = &&op_nequ_zbranch,
+        [OP_LT_ZBRANCH] = &&op_lt_zbranch, [OP_GT_ZBRANCH] = &&op_gt_zbranch,
+        [OP_LE_ZBRANCH] = &&op_le_zbranch, [OP_GE_ZBRANCH] = &&op_ge_zbranch,
+        [OP_ZEQU_ZBRANCH] = &&op_zequ_zbranch, [OP_TAILCALL] = &&op_tailcall,
+    };
+    Cell *vsp, *vrp, *vip; // local copies of the VM registers
+#if TOS_CACHE
+    Cell tos;
+#endif
+#if STATS
+    uint64_t vdocol = 1; // counting this one
+#endif
+#if STATS >= 2
+    uint64_t vdispatched = 0;
+#endif
+    Word *w;
+
+    SYNC_IN();
+    // same as the portable run(): push the old ip so the final EXIT pops it
+    *--vrp = (Cell)vip;
+    vip = (Cell *)start->params;
+    NEXT();
+
+op_resolve:
+    // first time this word has been dispatched, look up (and remember) its label
+    w->op = resolve_op(w->code);
+    goto *labels[w->op];
+op_call:
+    SYNC_OUT();
+    current_word = w;
+    w->code();
+    SYNC_IN();
+    if (vip == NULL) goto done;
+    NEXT();
+op_docol:
+    *--vrp = (Cell)vip;
+    vip = (Cell *)w->params;
+#if STATS
+    vdocol++;
+#endif
+    SAMPLE_DRAIN();
+    NEXT();
+op_exit:
+    vip = (Cell *)*vrp++;
+    if (vip == NULL) goto done;
+    NEXT();
+op_lit:
+    { Cell a = *vip++; PUSH1(a); }
+    NEXT();
+op_branch:
+    vip += *vip;
+    NEXT();
+op_zbranch:
+    { Cell a = TOS; DROP1(); if (a == 0) vip += *vip; else vip++; }
+    NEXT();
+op_drop:
+    DROP1();
+    NEXT();
+op_swap:
+    { Cell a = TOS; TOS = DEEP(1); DEEP(1) = a; }
+    NEXT();
+op_dup:
+    { Cell a = TOS; PUSH1(a); }
+    NEXT();
+op_over:
+    { Cell a = DEEP(1); PUSH1(a); }
+    NEXT();
+op_rot:
+    { Cell a = TOS, b = DEEP(1), c = DEEP(2); DEEP(2) = b; DEEP(1) = a; TOS = c; }
+    NEXT();
+op_nrot:
+    { Cell a = TOS, b = DEEP(1), c = DEEP(2); DEEP(2) = a; DEEP(1) = c; TOS = b; }
+    NEXT();
+op_twodrop:
+    DROP1();
+    DROP1();
+    NEXT();
+op_twodup:
+    { Cell a = TOS, b = DEEP(1); PUSH1(b); PUSH1(a); }
+    NEXT();
+op_twoswap:
+    {
+        Cell a = TOS, b = DEEP(1), c = DEEP(2), d = DEEP(3);
+        DEEP(3) = b; DEEP(2) = a; DEEP(1) = d; TOS = c;
+    }
+    NEXT();
+op_qdup:
+    { Cell a = TOS; if (a) PUSH1(a); }
+    NEXT();
+op_incr:
+    TOS++;
+    NEXT();
+op_decr:
+    TOS--;
+    NEXT();
+op_incr8:
+    TOS += 8;
+    NEXT();
+op_decr8:
+    TOS -= 8;
+    NEXT();
+op_add:
+    { Cell a = TOS; DROP1(); TOS += a; }
+    NEXT();
+op_sub:
+    { Cell a = TOS; DROP1(); TOS -= a; }
+    NEXT();
+op_mul:
+    { Cell a = TOS; DROP1(); TOS *= a; }
+    NEXT();
+op_div:
+    { Cell a = TOS; DROP1(); TOS /= a; }
+    NEXT();
+op_mod:
+    { Cell a = TOS; DROP1(); TOS %= a; }
+    NEXT();
+op_divmod:
+    { Cell a = TOS, b = DEEP(1); DEEP(1) = b % a; TOS = b / a; }
+    NEXT();
+op_equ:
+    { Cell a = TOS; DROP1(); TOS = (TOS == a); }
+    NEXT();
+op_nequ:
+    { Cell a = TOS; DROP1(); TOS = (TOS != a); }
+    NEXT();
+op_lt:
+    { Cell a = TOS; DROP1(); TOS = (TOS < a); }
+    NEXT();
+op_gt:
+    { Cell a = TOS; DROP1(); TOS = (TOS > a); }
+    NEXT();
+op_le:
+    { Cell a = TOS; DROP1(); TOS = (TOS <= a); }
+    NEXT();
+op_ge:
+    { Cell a = TOS; DROP1(); TOS = (TOS >= a); }
+    NEXT();
+op_zequ:
+    TOS = (TOS == 0);
+    NEXT();
+op_znequ:
+    TOS = (TOS != 0);
+    NEXT();
+op_zlt:
+    TOS = (TOS < 0);
+    NEXT();
+op_zgt:
+    TOS = (TOS > 0);
+    NEXT();
+op_zle:
+    TOS = (TOS <= 0);
+    NEXT();
+op_zge:
+    TOS = (TOS >= 0);
+    NEXT();
+op_and:
+    { Cell a = TOS; DROP1(); TOS &= a; }
+    NEXT();
+op_or:
+    { Cell a = TOS; DROP1(); TOS |= a; }
+    NEXT();
+op_xor:
+    { Cell a = TOS; DROP1(); TOS ^= a; }
+    NEXT();
+op_invert:
+    TOS = ~TOS;
+    NEXT();
+op_store:
+    { Cell *addr = (Cell *)TOS; Cell data = DEEP(1); DROP1(); DROP1(); *addr = data; }
+    NEXT();
+op_fetch:
+    TOS = *(Cell *)TOS;
+    NEXT();
+op_addstore:
+    { Cell *addr = (Cell *)TOS; Cell amount = DEEP(1); DROP1(); DROP1(); *addr += amount; }
+    NEXT();
+op_substore:
+    { Cell *addr = (Cell *)TOS; Cell amount = DEEP(1); DROP1(); DROP1(); *addr -= amount; }
+    NEXT();
+op_storebyte:
+    { uint8_t *addr = (uint8_t *)TOS; uint8_t data = (uint8_t)DEEP(1); DROP1(); DROP1(); *addr = data; }
+    NEXT();
+op_fetchbyte:
+    TOS = *(uint8_t *)TOS;
+    NEXT();
+op_tor:
+    { Cell a = TOS; DROP1(); *--vrp = a; }
+    NEXT();
+op_fromr:
+    { Cell a = *vrp++; PUSH1(a); }
+    NEXT();
+op_rdrop:
+    vrp++;
+    NEXT();
+op_litadd:
+    TOS += *vip++;
+    NEXT();
+op_litequ:
+    { Cell a = *vip++; TOS = (TOS == a); }
+    NEXT();
+op_dupadd:
+    TOS += TOS;
+    NEXT();
+op_equ_zbranch:
+    { Cell a = TOS, b = DEEP(1); DROP1(); DROP1(); if (b == a) vip++; else vip += *vip; }
+    NEXT();
+op_nequ_zbranch:
+    { Cell a = TOS, b = DEEP(1); DROP1(); DROP1(); if (b != a) vip++; else vip += *vip; }
+    NEXT();
+op_lt_zbranch:
+    { Cell a = TOS, b = DEEP(1); DROP1(); DROP1(); if (b < a) vip++; else vip += *vip; }
+    NEXT();
+op_gt_zbranch:
+    { Cell a = TOS, b = DEEP(1); DROP1(); DROP1(); if (b > a) vip++; else vip += *vip; }
+    NEXT();
+op_le_zbranch:
+    { Cell a = TOS, b = DEEP(1); DROP1(); DROP1(); if (b <= a) vip++; else vip += *vip; }
+    NEXT();
+op_ge_zbranch:
+    { Cell a = TOS, b = DEEP(1); DROP1(); DROP1(); if (b >= a) vip++; else vip += *vip; }
+    NEXT();
+op_zequ_zbranch:
+    { Cell a = TOS; DROP1(); if (a == 0) vip++; else vip += *vip; }
+    NEXT();
+op_tailcall:
+    vip = (Cell *)((Word *)*vip)->params;
+    NEXT();
+
+done:
+    SYNC_OUT();
+}
+
+#undef TOS
+#undef DEEP
+#undef DROP1
+#undef PUSH1
+#undef SYNC_OUT
+#undef SYNC_IN
+#undef NEXT
+#undef STATS_OUT
+#endif
+
+Word *find(const char *name) {
+    // unlike FIND this also finds hidden words
+    return dict_lookup(name, strlen(name), 0);
+}
+
+void call_word(Word *w) {
+    // run any word from C code and come back when it's done; with ip NULL,
+    // run() returns when a colon word EXITs instead of carrying on with whoever
+    // called us
+    if (w->code == docol) {
+        Cell *saved_ip = ip;
+        ip = NULL;
+        run(w);
+        ip = saved_ip;
+    } else {
+        current_word = w;
+        w->code();
+    }
+}
+
+char *get_token(char **input_ptr) {
+    static char token[TOKEN_SIZE];
+    char *in = *input_ptr;
+    char *out = token;
+
+    // Skip whitespace
+    while (*in && isspace(*in)) in++;
+
+    // Copy next word
+    while (*in && !isspace(*in)) {
+        *out++ = *in++;
+    }
+    *out = '\0';
+    *input_ptr = in; // interesting... updates the pointer itself
+
+    return token;
+}
+
+// TODO I think if we finish converting JonesForth then
+// interpret will run in Forth when you initially run QUIT
+// instead of having this C function (TBD)
+// Converted this function to use WORD and work like it does in JonesForth
+// TODO make this a word as well (INTERPRET)
+
+int words_remain(void) {
+    // determine if there are any words left on the current line
+    // to prevent do_interpret from trying to get more words unnecessarily
+
+    size_t offset = 0; // from currkey, which moves if refill() has to read more
+    while (1) {
+        char *p = input.buffer + input.currkey + offset;
+        size_t n = input.bufftop - input.currkey - offset;
+        size_t space = scan_bytes(p, n, 0);
+        if (memchr(p, '\n', space)) {
+            return(0); // the rest of the line is empty
+        }
+        if (space < n) {
+            return(p[space] != '\\'); // or a comment
+        }
+        offset += space;
+        if (!refill()) {
+            return(0);
+        }
+    }
+}
+
+int skip_line(void) {
+    // move past the end of the current line, returns 0 if there's no more input;
+    // doesn't wait for the next line to be typed, the REPL has a prompt to print
+    while (1) {
+        char *nl = memchr(input.buffer + input.currkey, '\n', input.bufftop - input.currkey);
+        if (nl) {
+            input.currkey = nl + 1 - input.buffer;
+            return input.currkey < input.bufftop || input.size;
+        }
+        input.currkey = input.bufftop;
+        if (!refill()) {
+            return 0;
+        }
+    }
+}
+
+#if JIT
+// Template JIT for x86-64.
+//
+// Native code for a word keeps the data stack pointer in rbx ([rbx] is the top
+// of the stack) and uses rax, rcx and rdx as scratch. Each word gets:
+//   outer: loads rbx from sp, calls inner, stores rbx back to sp, returns.
+//          This is what goes in Word.code, so run() and do_interpret call it like
+//          any other primitive.
+//   inner: the body, one template per word. JIT'd words call each other's inner
+//          directly, so rbx stays live and the machine stack is the return stack.
+// Words without a template have their C function called, with sp written back
+// before and reloaded after. Colon words that weren't JIT'd are run by run().
+// The threaded body in params is left alone for >DFA and debugging.
+// Anything that needs the real return stack (RDROP, RSP@, RSP!, an R> that
+// doesn't match a >R earlier in the word) or an operand we don't know about
+// stays threaded.
+#define JIT_SIZE (16 * 1024 * 1024)
+#define JIT_MAX_TEMPLATE 64 // more than the biggest single instruction we emit
+uint8_t *jit_base = NULL;
+uint8_t *jit_here;
+uint8_t *jit_end;
+extern size_t page_size; // stacks_init() sets it, below
+
+const uint8_t jit_outer[] = {
+    0x53,                               // push rbx
+    0x48, 0xB8, 0, 0, 0, 0, 0, 0, 0, 0, // mov rax, &sp       (patched at 3)
+    0x48, 0x8B, 0x18,                   // mov rbx, [rax]
+    0xE8, 15, 0, 0, 0,                  // call inner, which starts right after this
+    0x48, 0xB8, 0, 0, 0, 0, 0, 0, 0, 0, // mov rax, &sp       (patched at 21)
+    0x48, 0x89, 0x18,                   // mov [rax], rbx
+    0x5B,                               // pop rbx
+    0xC3,                               // ret
+};
+#define JIT_INNER(code) ((uint8_t *)(code) + sizeof(jit_outer))
+
+#define T(...) (const uint8_t[]){ __VA_ARGS__ }, sizeof((const uint8_t[]){ __VA_ARGS__ })
+// a few pieces that templates are made of
+#define POP_RAX      0x48, 0x8B, 0x03, 0x48, 0x83, 0xC3, 0x08 // mov rax,[rbx]; add rbx,8
+#define PUSH_RAX     0x48, 0x83, 0xEB, 0x08, 0x48, 0x89, 0x03 // sub rbx,8; mov [rbx],rax
+#define POP_RAX_RCX  0x48, 0x8B, 0x03, 0x48, 0x8B, 0x4B, 0x08, 0x48, 0x83, 0xC3, 0x10 // a in rax, b in rcx
+#define FLAG_TO_TOS  0x0F, 0xB6, 0xC0, 0x48, 0x89, 0x03        // movzx eax,al; mov [rbx],rax
+
+struct { Word *w; const uint8_t *code; size_t length; } jit_templates[] = {
+    { &word_drop,    T(0x48, 0x83, 0xC3, 0x08) },
+    { &word_dup,     T(0x48, 0x8B, 0x03, PUSH_RAX) },
+    { &word_over,    T(0x48, 0x8B, 0x43, 0x08, PUSH_RAX) },
+    { &word_swap,    T(0x48, 0x8B, 0x03, 0x48, 0x8B, 0x4B, 0x08, 0x48, 0x89, 0x0B, 0x48, 0x89, 0x43, 0x08) },
+    { &word_rot,     T(0x48, 0x8B, 0x03, 0x48, 0x8B, 0x4B, 0x08, 0x48, 0x8B, 0x53, 0x10,   // a b c in rax rcx rdx
+                       0x48, 0x89, 0x4B, 0x10, 0x48, 0x89, 0x43, 0x08, 0x48, 0x89, 0x13) },
+    { &word_nrot,    T(0x48, 0x8B, 0x03, 0x48, 0x8B, 0x4B, 0x08, 0x48, 0x8B, 0x53, 0x10,
+                       0x48, 0x89, 0x43, 0x10, 0x48, 0x89, 0x53, 0x08, 0x48, 0x89, 0x0B) },
+    { &word_twodrop, T(0x48, 0x83, 0xC3, 0x10) },
+    { &word_twodup,  T(0x48, 0x8B, 0x03, 0x48, 0x8B, 0x4B, 0x08, 0x48, 0x83, 0xEB, 0x10,
+                       0x48, 0x89, 0x4B, 0x08, 0x48, 0x89, 0x03) },
+    { &word_incr,    T(0x48, 0x83, 0x03, 0x01) },
+    { &word_decr,    T(0x48, 0x83, 0x2B, 0x01) },
+    { &word_incr8,   T(0x48, 0x83, 0x03, 0x08) },
+    { &word_decr8,   T(0x48, 0x83, 0x2B, 0x08) },
+    { &word_add,     T(POP_RAX, 0x48, 0x01, 0x03) },             // add [rbx],rax
+    { &word_sub,     T(POP_RAX, 0x48, 0x29, 0x03) },             // sub [rbx],rax
+    { &word_and,     T(POP_RAX, 0x48, 0x21, 0x03) },
+    { &word_or,      T(POP_RAX, 0x48, 0x09, 0x03) },
+    { &word_xor,     T(POP_RAX, 0x48, 0x31, 0x03) },
+    { &word_mul,     T(POP_RAX, 0x48, 0x0F, 0xAF, 0x03, 0x48, 0x89, 0x03) }, // imul rax,[rbx]; mov [rbx],rax
+    { &word_invert,  T(0x48, 0xF7, 0x13) },                      // not qword [rbx]
+    { &word_dupadd,  T(0x48, 0xD1, 0x23) },                      // shl qword [rbx],1
+    // ( b a -- flag ): cmp [rbx],rax; setcc al
+    { &word_equ,     T(POP_RAX, 0x48, 0x39, 0x03, 0x0F, 0x94, 0xC0, FLAG_TO_TOS) },
+    { &word_nequ,    T(POP_RAX, 0x48, 0x39, 0x03, 0x0F, 0x95, 0xC0, FLAG_TO_TOS) },
+    { &word_lt,      T(POP_RAX, 0x48, 0x39, 0x03, 0x0F, 0x9C, 0xC0, FLAG_TO_TOS) },
+    { &word_gt,      T(POP_RAX, 0x48, 0x39, 0x03, 0x0F, 0x9F, 0xC0, FLAG_TO_TOS) },
+    { &word_le,      T(POP_RAX, 0x48, 0x39, 0x03, 0x0F, 0x9E, 0xC0, FLAG_TO_TOS) },
+    { &word_ge,      T(POP_RAX, 0x48, 0x39, 0x03, 0x0F, 0x9D, 0xC0, FLAG_TO_TOS) },
+    // ( n -- flag ): cmp qword [rbx],0; setcc al
+    { &word_zequ,    T(0x48, 0x83, 0x3B, 0x00, 0x0F, 0x94, 0xC0, FLAG_TO_TOS) },
+    { &word_znequ,   T(0x48, 0x83, 0x3B, 0x00, 0x0F, 0x95, 0xC0, FLAG_TO_TOS) },
+    { &word_zlt,     T(0x48, 0x83, 0x3B, 0x00, 0x0F, 0x9C, 0xC0, FLAG_TO_TOS) },
+    { &word_zgt,     T(0x48, 0x83, 0x3B, 0x00, 0x0F, 0x9F, 0xC0, FLAG_TO_TOS) },
+    { &word_zle,     T(0x48, 0x83, 0x3B, 0x00, 0x0F, 0x9E, 0xC0, FLAG_TO_TOS) },
+    { &word_zge,     T(0x48, 0x83, 0x3B, 0x00, 0x0F, 0x9D, 0xC0, FLAG_TO_TOS) },
+    { &word_fetch,   T(0x48, 0x8B, 0x03, 0x48, 0x8B, 0x00, 0x48, 0x89, 0x03) },   // mov rax,[rax]
+    { &word_fetchbyte, T(0x48, 0x8B, 0x03, 0x0F, 0xB6, 0x00, 0x48, 0x89, 0x03) }, // movzx eax,byte [rax]
+    { &word_store,   T(POP_RAX_RCX, 0x48, 0x89, 0x08) },         // mov [rax],rcx
+    { &word_addstore, T(POP_RAX_RCX, 0x48, 0x01, 0x08) },        // add [rax],rcx
+    { &word_substore, T(POP_RAX_RCX, 0x48, 0x29, 0x08) },        // sub [rax],rcx
+    { &word_storebyte, T(POP_RAX_RCX, 0x88, 0x08) },             // mov [rax],cl
+};
+
+// conditional branches: the bytes before the jcc, and the jcc's second opcode byte (0F xx)
+struct { Word *w; const uint8_t *code; size_t length; uint8_t jcc; } jit_branches[] = {
+    { &word_zbranch,      T(POP_RAX, 0x48, 0x85, 0xC0), 0x84 },      // test rax,rax; jz
+    { &word_zequ_zbranch, T(POP_RAX, 0x48, 0x85, 0xC0), 0x85 },      // jnz
+    // ( b a ): cmp rcx,rax and jump when the comparison is false
+    { &word_equ_zbranch,  T(POP_RAX_RCX, 0x48, 0x39, 0xC1), 0x85 },  // jne
+    { &word_nequ_zbranch, T(POP_RAX_RCX, 0x48, 0x39, 0xC1), 0x84 },  // je
+    { &word_lt_zbranch,   T(POP_RAX_RCX, 0x48, 0x39, 0xC1), 0x8D },  // jge
+    { &word_gt_zbranch,   T(POP_RAX_RCX, 0x48, 0x39, 0xC1), 0x8E },  // jle
+    { &word_le_zbranch,   T(POP_RAX_RCX, 0x48, 0x39, 0xC1), 0x8F },  // jg
+    { &word_ge_zbranch,   T(POP_RAX_RCX, 0x48, 0x39, 0xC1), 0x8C },  // jl
+};
+#undef T
+
+int jit_owns(CodeFn code) {
+    return jit_base && (uint8_t *)code >= jit_base && (uint8_t *)code < jit_end;
+}
+
+void jit_emit(const void *bytes, size_t n) {
+    memcpy(jit_here, bytes, n);
+    jit_here += n;
+}
+
+void jit_emit_imm64(Cell x) {
+    jit_emit(&x, 8);
+}
+
+void jit_emit_rel32(uint8_t *target) {
+    // relative to the end of the 4 byte field
+    int32_t rel = (int32_t)(target - (jit_here + 4));
+    jit_emit(&rel, 4);
+}
+
+void jit_emit_call_c(void *fn, Word *arg) {
+    // call fn(arg) with sp up to date
+    jit_emit((uint8_t[]){ 0x48, 0xB8 }, 2);        // mov rax, &sp
+    jit_emit_imm64((Cell)&sp);
+    jit_emit((uint8_t[]){ 0x48, 0x89, 0x18 }, 3);  // mov [rax], rbx
+    if (arg) {
+        jit_emit((uint8_t[]){ 0x48, 0xBF }, 2);    // mov rdi, arg
+        jit_emit_imm64((Cell)arg);
+    }
+    jit_emit((uint8_t[]){ 0x48, 0xB8 }, 2);        // mov rax, fn
+    jit_emit_imm64((Cell)fn);
+    jit_emit((uint8_t[]){ 0xFF, 0xD0 }, 2);        // call rax
+    jit_emit((uint8_t[]){ 0x48, 0xB8 }, 2);        // mov rax, &sp
+    jit_emit_imm64((Cell)&sp);
+    jit_emit((uint8_t[]){ 0x48, 0x8B, 0x18 }, 3);  // mov rbx, [rax]
+}
+
+const uint8_t jit_epilogue[] = { 0x48, 0x83, 0xC4, 0x08, 0xC3 }; // add rsp,8; ret
+
+int jit_compile(Word *w, Cell *end) {
+    // Translate w's body (up to end) to native code and point w->code at it.
+    // Returns 0, leaving w threaded, if the body has something we can't do.
+    if (jit_base == NULL) {
+        void *m = mmap(NULL, JIT_SIZE, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (m == MAP_FAILED) {
+            return 0;
+        }
+        jit_base = jit_here = m;
+        jit_end = jit_base + JIT_SIZE;
+    }
+    Cell *body = (Cell *)w->params;
+    size_t n = end - body;
+    // the code buffer is never writable and executable at once: the pages
+    // this word could need are writable while we're at it, executable after
+    size_t most = sizeof(jit_outer) + (n + 2) * JIT_MAX_TEMPLATE;
+    uint8_t *writable = (uint8_t *)((uintptr_t)jit_here & -(uintptr_t)page_size);
+    uint8_t *limit = (size_t)(jit_end - jit_here) <= most ? jit_end
+        : (uint8_t *)(((uintptr_t)jit_here + most + page_size - 1) & -(uintptr_t)page_size);
+    if (mprotect(writable, limit - writable, PROT_READ | PROT_WRITE) != 0) {
+        return 0;
+    }
+    uint8_t **native = calloc(n + 1, sizeof(uint8_t *)); // where each cell's code starts
+    Cell *fixups = malloc(n * sizeof(Cell));               // body cell whose branch needs patching
+    uint8_t **fixup_at = malloc(n * sizeof(uint8_t *));    // the rel32 to patch
+    size_t nfixups = 0;
+    uint8_t *start = jit_here;
+    int ok = 0;
+    int rdepth = 0; // >R minus R> so far
+    if (!native || !fixups || !fixup_at) goto done;
+
+    if ((size_t)(limit - jit_here) < sizeof(jit_outer) + JIT_MAX_TEMPLATE) goto done;
+    jit_emit(jit_outer, sizeof(jit_outer));
+    memcpy(start + 3, &(Cell){ (Cell)&sp }, 8);
+    memcpy(start + 21, &(Cell){ (Cell)&sp }, 8);
+    uint8_t *inner = jit_here;
+    jit_emit((uint8_t[]){ 0x48, 0x83, 0xEC, 0x08 }, 4); // sub rsp,8 to keep calls 16 byte aligned
+
+    size_t i = 0;
+    while (i < n) {
+        if ((size_t)(limit - jit_here) < JIT_MAX_TEMPLATE) goto done;
+        Word *x = (Word *)body[i];
+        if (!is_word(x)) {
+            goto done; // something , in that isn't code
+        }
+        native[i] = jit_here;
+        size_t t;
+        i++;
+        for (t = 0; t < sizeof(jit_templates) / sizeof(jit_templates[0]); t++) {
+            if (jit_templates[t].w == x) break;
+        }
+        if (t < sizeof(jit_templates) / sizeof(jit_templates[0])) {
+            jit_emit(jit_templates[t].code, jit_templates[t].length);
+            continue;
+        }
+        for (t = 0; t < sizeof(jit_branches) / sizeof(jit_branches[0]); t++) {
+            if (jit_branches[t].w == x) break;
+        }
+        if (t < sizeof(jit_branches) / sizeof(jit_branches[0])) {
+            jit_emit(jit_branches[t].code, jit_branches[t].length);
+            jit_emit((uint8_t[]){ 0x0F, jit_branches[t].jcc }, 2);
+            fixups[nfixups] = i + body[i];
+            fixup_at[nfixups++] = jit_here;
+            jit_emit_rel32(jit_here); // patched below
+            i++;
+            continue;
+        }
+        if (x == &word_branch) {
+            jit_emit((uint8_t[]){ 0xE9 }, 1);          // jmp
+            fixups[nfixups] = i + body[i];
+            fixup_at[nfixups++] = jit_here;
+            jit_emit_rel32(jit_here);
+            i++;
+        } else if (x == &word_lit || x == &word_tick) {
+            jit_emit((uint8_t[]){ 0x48, 0xB8 }, 2);    // mov rax, n
+            jit_emit_imm64(body[i++]);
+            jit_emit((uint8_t[]){ PUSH_RAX }, 7);
+        } else if (x == &word_litadd || x == &word_litequ) {
+            jit_emit((uint8_t[]){ 0x48, 0xB8 }, 2);    // mov rax, n
+            jit_emit_imm64(body[i++]);
+            if (x == &word_litadd) {
+                jit_emit((uint8_t[]){ 0x48, 0x01, 0x03 }, 3); // add [rbx],rax
+            } else {
+                jit_emit((uint8_t[]){ 0x48, 0x39, 0x03, 0x0F, 0x94, 0xC0, FLAG_TO_TOS }, 12);
+            }
+        } else if (x == &word_exit) {
+            jit_emit(jit_epilogue, sizeof(jit_epilogue));
+        } else if (x == &word_tailcall) {
+            Word *callee = (Word *)body[i++];
+            if (callee == w || jit_owns(callee->code)) {
+                jit_emit((uint8_t[]){ 0x48, 0x83, 0xC4, 0x08, 0xE9 }, 5); // add rsp,8; jmp inner
+                jit_emit_rel32(callee == w ? inner : JIT_INNER(callee->code));
+            } else {
+                jit_emit_call_c(call_word, callee);
+                jit_emit(jit_epilogue, sizeof(jit_epilogue));
+            }
+        } else if (x == &word_rdrop || x == &word_rspfetch || x == &word_rspstore) {
+            goto done;
+        } else if (operand_cells(x) > 0) {
+            goto done; // no idea what its operand means
+        } else if (is_colon_word(x) && uses_return_stack(x)) {
+            goto done; // native code has no return stack frame for it to take
+        } else if (x == w || jit_owns(x->code)) {
+            jit_emit((uint8_t[]){ 0xE8 }, 1);          // call inner
+            jit_emit_rel32(x == w ? inner : JIT_INNER(x->code));
+        } else if (x->code == docol) {
+            jit_emit_call_c(call_word, x);
+        } else if (x->code == do_dovar) {
+            jit_emit((uint8_t[]){ 0x48, 0xB8 }, 2);    // mov rax, its address
+            jit_emit_imm64((Cell)x->params);
+            jit_emit((uint8_t[]){ PUSH_RAX }, 7);
+        } else {
+            if (x == &word_tor) {
+                rdepth++;
+            } else if (x == &word_fromr && --rdepth < 0) {
+                goto done; // taking something off the return stack it didn't put there
+            }
+            jit_emit_call_c(x->code, NULL);
+        }
+    }
+    native[n] = jit_here;
+    jit_emit(jit_epilogue, sizeof(jit_epilogue)); // in case the end is reachable without an EXIT
+
+    for (size_t k = 0; k < nfixups; k++) {
+        if (fixups[k] < 0 || fixups[k] > (Cell)n || native[fixups[k]] == NULL) goto done;
+        uint8_t *saved = jit_here;
+        jit_here = fixup_at[k];
+        jit_emit_rel32(native[fixups[k]]);
+        jit_here = saved;
+    }
+    w->code = (CodeFn)start;
+    w->flags |= F_JIT;
+#if THREADED_GOTO
+    w->op = 0;
+#endif
+    ok = 1;
+
+done:
+    if (!ok) {
+        jit_here = start; // throw away whatever we emitted
+    }
+    mprotect(writable, limit - writable, PROT_READ | PROT_EXEC);
+    free(native);
+    free(fixups);
+    free(fixup_at);
+    return ok;
+}
+#undef POP_RAX
+#undef PUSH_RAX
+#undef POP_RAX_RCX
+#undef FLAG_TO_TOS
+#endif
+
+// inlining
+
+#define INLINE_SCAN_MAX 256 // give up looking for the end of a body after this many cells
+#define INLINE_DEPTH 4      // how deep inlined bodies get inlined into in turn
+
+Cell inline_length(Word *w, int *has_branches) {
+    // Number of cells in w's body before its EXIT if it is OK to copy the body
+    // in place of a call to w, otherwise -1.
+    if (!is_docol(w) || w->params == NULL || (w->flags & F_NOINLINE)) {
+        return -1;
+    }
+    Cell *body = (Cell *)w->params;
+    Cell length = -1;
+    Cell furthest = 0; // furthest branch target seen
+    *has_branches = 0;
+    for (Cell i = 0; i < INLINE_SCAN_MAX; i += 1 + operand_cells((Word *)body[i])) {
+        Word *x = (Word *)body[i];
+        if (x == &word_exit) {
+            length = i;
+            break;
+        }
+        if (is_return_stack_word(x) || (is_colon_word(x) && uses_return_stack(x))) {
+            // messes with the return stack (or calls something that pops its
+            // caller's return address), which is different once inlined
+            return -1;
+        }
+        if (x == &word_tailcall) {
+            // leaves the word without coming back to the one it'd be inlined into
+            return -1;
+        }
+        if (is_branch(x)) {
+            Cell t = i + 1 + body[i + 1];
+            if (t < 0) return -1;
+            if (t > furthest) furthest = t;
+            *has_branches = 1;
+        }
+    }
+    if (length < 0 || furthest > length) {
+        // no EXIT found, or it isn't the end of the word (something branches past it)
+        return -1;
+    }
+    if (length > INLINE_LIMIT && !(w->flags & F_INLINE)) {
+        return -1;
+    }
+    return length;
+}
+
+void compile_word(Word *w, int depth) {
+    // compile w into the word being defined, inlining it if allowed
+    int has_branches;
+    Cell length = depth < INLINE_DEPTH ? inline_length(w, &has_branches) : -1;
+    if (length < 0) {
+        push((Cell)w);
+        do_comma();
+        return;
+    }
+    Cell *body = (Cell *)w->params;
+    for (Cell i = 0; i < length; ) {
+        Word *x = (Word *)body[i++];
+        if (has_branches) {
+            // inlining anything further would move the branch targets
+            push((Cell)x);
+            do_comma();
+        } else {
+            compile_word(x, depth + 1);
+        }
+        for (int k = operand_cells(x); k > 0; k--) {
+            push(body[i++]);
+            do_comma();
+        }
+    }
+}
+
+// constant folding
+
+// The LIT cells do_interpret has just compiled, oldest first, acting as a
+// compile time copy of what will be on the stack. Only valid while here is
+// still fold_here, i.e. nothing else has been compiled since the last one.
+#define FOLD_DEPTH 8
+Cell *fold_lits[FOLD_DEPTH];
+int fold_count = 0;
+void *fold_here = NULL;
+
+void fold_literal(Cell *lit) {
+    // lit is a LIT cell that was just compiled
+    if ((void *)lit != fold_here) {
+        fold_count = 0;
+    }
+    if (fold_count == FOLD_DEPTH) {
+        memmove(fold_lits, fold_lits + 1, (FOLD_DEPTH - 1) * sizeof(Cell *));
+        fold_count--;
+    }
+    fold_lits[fold_count++] = lit;
+    fold_here = lit + 2;
+}
+
+int fold_arity(Word *w) {
+    // how many inputs w takes if it only computes a result from them, else 0
+    if (w == &word_add || w == &word_sub || w == &word_mul || w == &word_div
+            || w == &word_mod || w == &word_and || w == &word_or || w == &word_xor
+            || w == &word_equ || w == &word_nequ || w == &word_lt || w == &word_gt
+            || w == &word_le || w == &word_ge) {
+        return 2;
+    }
+    if (w == &word_incr || w == &word_decr || w == &word_incr8 || w == &word_decr8
+            || w == &word_invert || w == &word_zequ || w == &word_znequ || w == &word_zlt
+            || w == &word_zgt || w == &word_zle || w == &word_zge) {
+        return 1;
+    }
+    return 0;
+}
+
+int fold_constant(Word *w) {
+    // If w's inputs are all literals just compiled, run w now and replace them
+    // with a single LIT of the result. Returns 0 if w still needs compiling.
+    int arity = fold_arity(w);
+    if (!CONST_FOLD || arity == 0 || fold_count < arity || here != fold_here) {
+        return 0;
+    }
+    Cell *first = fold_lits[fold_count - arity];
+    if (w == &word_div || w == &word_mod) {
+        Cell a = first[1], b = first[3];
+        if (b == 0 || (b == -1 && a == INTPTR_MIN)) {
+            return 0; // leave the fault to happen at run time, when it would have
+        }
+    }
+    // the primitive itself does the arithmetic so the answer is exactly what it would be at run time
+    for (int i = 0; i < arity; i++) {
+        push(first[2 * i + 1]);
+    }
+    current_word = w;
+    w->code();
+    Cell result = pop();
+
+    fold_count -= arity;
+    here = first;
+    push((Cell)&word_lit);
+    do_comma();
+    push(result);
+    do_comma();
+    fold_here = first; // the result carries on from the literals before it
+    fold_literal(first);
+    return 1;
+}
+
+// SAVE-C, ahead of time translation of colon words to C
+//
+// SAVE-C <file> writes every colon word defined since startup out as a C
+// function plus a Word for it. Build that file into the interpreter with
+//   gcc -O2 -DAOT_FILE='"file.c"' riversforth.c
+// and main() adds the words back with add_word() as primitives, so they get
+// the C compiler's full optimization without a JIT.
+//
+// Literals become constants, branches become gotos, the common primitives are
+// written out inline, and calls between translated words are plain C calls.
+// Any other built in word is looked up by name when the file is loaded, so the
+// file doesn't depend on where things are in memory. Words that need a real
+// return stack frame (RDROP, RSP@, RSP!, an unmatched R>), that use something
+// we can't name (a CREATEd word, a word that wasn't translated) stay behind and
+// have to be loaded from source again.
+// Literal addresses of things in the dictionary are written out as numbers,
+// which won't mean anything in the next run.
+
+#define AOT_MAX_WORDS 4096
+
+struct { Word *w; const char *c; } aot_templates[] = {
+    { &word_drop,      "sp++;" },
+    { &word_dup,       "sp--; sp[0] = sp[1];" },
+    { &word_over,      "sp--; sp[0] = sp[2];" },
+    { &word_swap,      "{ Cell t = sp[0]; sp[0] = sp[1]; sp[1] = t; }" },
+    { &word_rot,       "{ Cell t = sp[2]; sp[2] = sp[1]; sp[1] = sp[0]; sp[0] = t; }" },
+    { &word_nrot,      "{ Cell t = sp[0]; sp[0] = sp[1]; sp[1] = sp[2]; sp[2] = t; }" },
+    { &word_twodrop,   "sp += 2;" },
+    { &word_twodup,    "sp -= 2; sp[0] = sp[2]; sp[1] = sp[3];" },
+    { &word_incr,      "sp[0] += 1;" },
+    { &word_decr,      "sp[0] -= 1;" },
+    { &word_incr8,     "sp[0] += 8;" },
+    { &word_decr8,     "sp[0] -= 8;" },
+    { &word_add,       "sp[1] += sp[0]; sp++;" },
+    { &word_sub,       "sp[1] -= sp[0]; sp++;" },
+    { &word_mul,       "sp[1] *= sp[0]; sp++;" },
+    { &word_and,       "sp[1] &= sp[0]; sp++;" },
+    { &word_or,        "sp[1] |= sp[0]; sp++;" },
+    { &word_xor,       "sp[1] ^= sp[0]; sp++;" },
+    { &word_invert,    "sp[0] = ~sp[0];" },
+    { &word_dupadd,    "sp[0] += sp[0];" },
+    { &word_equ,       "sp[1] = sp[1] == sp[0]; sp++;" },
+    { &word_nequ,      "sp[1] = sp[1] != sp[0]; sp++;" },
+    { &word_lt,        "sp[1] = sp[1] < sp[0]; sp++;" },
+    { &word_gt,        "sp[1] = sp[1] > sp[0]; sp++;" },
+    { &word_le,        "sp[1] = sp[1] <= sp[0]; sp++;" },
+    { &word_ge,        "sp[1] = sp[1] >= sp[0]; sp++;" },
+    { &word_zequ,      "sp[0] = sp[0] == 0;" },
+    { &word_znequ,     "sp[0] = sp[0] != 0;" },
+    { &word_zlt,       "sp[0] = sp[0] < 0;" },
+    { &word_zgt,       "sp[0] = sp[0] > 0;" },
+    { &word_zle,       "sp[0] = sp[0] <= 0;" },
+    { &word_zge,       "sp[0] = sp[0] >= 0;" },
+    { &word_fetch,     "sp[0] = *(Cell *)sp[0];" },
+    { &word_fetchbyte, "sp[0] = *(uint8_t *)sp[0];" },
+    { &word_store,     "*(Cell *)sp[0] = sp[1]; sp += 2;" },
+    { &word_addstore,  "*(Cell *)sp[0] += sp[1]; sp += 2;" },
+    { &word_substore,  "*(Cell *)sp[0] -= sp[1]; sp += 2;" },
+    { &word_storebyte, "*(uint8_t *)sp[0] = (uint8_t)sp[1]; sp += 2;" },
+    { &word_exit,      "return;" },
+};
+
+// conditional branches: goto the target when this is true
+struct { Word *w; const char *c; int pops; } aot_branches[] = {
+    { &word_zbranch,      "sp[0] == 0",     1 },
+    { &word_zequ_zbranch, "sp[0] != 0",     1 },
+    { &word_equ_zbranch,  "sp[1] != sp[0]", 2 },
+    { &word_nequ_zbranch, "sp[1] == sp[0]", 2 },
+    { &word_lt_zbranch,   "sp[1] >= sp[0]", 2 },
+    { &word_gt_zbranch,   "sp[1] <= sp[0]", 2 },
+    { &word_le_zbranch,   "sp[1] > sp[0]",  2 },
+    { &word_ge_zbranch,   "sp[1] < sp[0]",  2 },
+};
+
+const char *aot_template(Word *w) {
+    for (size_t t = 0; t < sizeof(aot_templates) / sizeof(aot_templates[0]); t++) {
+        if (aot_templates[t].w == w) return aot_templates[t].c;
+    }
+    return NULL;
+}
+
+int aot_branch(Word *w) {
+    // index into aot_branches, or -1
+    for (size_t t = 0; t < sizeof(aot_branches) / sizeof(aot_branches[0]); t++) {
+        if (aot_branches[t].w == w) return t;
+    }
+    return -1;
+}
+
+int aot_find(Word **words, int n, Word *w) {
+    for (int k = 0; k < n; k++) {
+        if (words[k] == w) return k;
+    }
+    return -1;
+}
+
+int aot_nameable(Word *w, Word **words, int n, const char *ok) {
+    // can the generated file get hold of w?
+    if (in_dictionary(w)) {
+        int k = aot_find(words, n, w);
+        return k >= 0 && ok[k];
+    }
+    return w->name && find(w->name) == w; // a built in word we can look up by name
+}
+
+Cell *aot_body_end(Word *w, Cell *limit) {
+    // just after the last EXIT in w's body, or NULL if there isn't one. The
+    // next header is only a limit: whatever was forgotten, or , in without
+    // being a word, can sit in between, so stop at the first cell that isn't
+    // a word we know.
+    Cell *body = (Cell *)w->params;
+    Cell *end = NULL;
+    for (Cell *c = body; c < limit && is_word((Word *)*c); c += 1 + operand_cells((Word *)*c)) {
+        if ((Word *)*c == &word_exit) {
+            end = c + 1;
+        }
+    }
+    return end;
+}
+
+int aot_check(Word *w, Cell *end, Word **words, int n, const char *ok) {
+    // is everything in w's body (up to end) something we can write out?
+    Cell *body = (Cell *)w->params;
+    Cell length = end - body;
+    int rdepth = 0;
+    for (Cell i = 0; i < length; i += 1 + operand_cells((Word *)body[i])) {
+        Word *x = (Word *)body[i];
+        if (is_branch(x)) {
+            Cell target = i + 1 + body[i + 1];
+            if (i + 1 >= length || target < 0 || target > length) return 0;
+        } else if (x == &word_lit || x == &word_litadd || x == &word_litequ) {
+            if (i + 1 >= length) return 0;
+        } else if (x == &word_tick || x == &word_tailcall) {
+            if (i + 1 >= length || !aot_nameable((Word *)body[i + 1], words, n, ok)) return 0;
+        } else if (x == &word_rdrop || x == &word_rspfetch || x == &word_rspstore) {
+            return 0;
+        } else if (x == &word_tor) {
+            rdepth++;
+        } else if (x == &word_fromr) {
+            if (--rdepth < 0) return 0;
+        } else if (aot_template(x) == NULL && !aot_nameable(x, words, n, ok)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+void aot_emit_ref(FILE *f, Word *x, Word **words, int n, Word **refs, int *nrefs) {
+    // an expression for the address of x
+    int k = aot_find(words, n, x);
+    if (k >= 0) {
+        fprintf(f, "&aot_word_%d", k);
+        return;
+    }
+    int r = aot_find(refs, *nrefs, x);
+    if (r < 0) {
+        r = (*nrefs)++;
+        refs[r] = x;
+    }
+    fprintf(f, "aot_refs[%d]", r);
+}
+
+void aot_emit_cell(FILE *f, Cell x) {
+    if (x == INTPTR_MIN) {
+        fprintf(f, "INTPTR_MIN"); // -9223372036854775808 would be minus a number too big for a long
+    } else {
+        fprintf(f, "%ld", (long)x);
+    }
+}
+
+void aot_emit_string(FILE *f, const char *s) {
+    fputc('"', f);
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\') {
+            fprintf(f, "\\%c", *s);
+        } else if (isprint((unsigned char)*s)) {
+            fputc(*s, f);
+        } else {
+            fprintf(f, "\\%03o", (unsigned char)*s);
+        }
+    }
+    fputc('"', f);
+}
+
+void aot_emit_body(FILE *f, int k, Cell *end, Word **words, int n, Word **refs, int *nrefs) {
+    Cell *body = (Cell *)words[k]->params;
+    Cell length = end - body;
+    char *target = calloc(length + 1, 1); // cells that need a label
+    for (Cell i = 0; i < length; i += 1 + operand_cells((Word *)body[i])) {
+        if (is_branch((Word *)body[i])) {
+            target[i + 1 + body[i + 1]] = 1;
+        }
+    }
+
+    fprintf(f, "\nvoid aot_fn_%d(void) {\n    // %s\n", k, words[k]->name);
+    for (Cell i = 0; i < length; i += 1 + operand_cells((Word *)body[i])) {
+        Word *x = (Word *)body[i];
+        int b = aot_branch(x);
+        const char *c = aot_template(x);
+        if (target[i]) {
+            fprintf(f, "l%ld:\n", (long)i);
+        }
+        fprintf(f, "    ");
+        if (b >= 0) {
+            fprintf(f, "if (%s) { sp += %d; goto l%ld; } sp += %d;\n", aot_branches[b].c,
+                    aot_branches[b].pops, (long)(i + 1 + body[i + 1]), aot_branches[b].pops);
+        } else if (x == &word_branch) {
+            fprintf(f, "goto l%ld;\n", (long)(i + 1 + body[i + 1]));
+        } else if (x == &word_lit) {
+            fprintf(f, "*--sp = ");
+            aot_emit_cell(f, body[i + 1]);
+            fprintf(f, ";\n");
+        } else if (x == &word_litadd) {
+            fprintf(f, "sp[0] += ");
+            aot_emit_cell(f, body[i + 1]);
+            fprintf(f, ";\n");
+        } else if (x == &word_litequ) {
+            fprintf(f, "sp[0] = sp[0] == ");
+            aot_emit_cell(f, body[i + 1]);
+            fprintf(f, ";\n");
+        } else if (x == &word_tick) {
+            fprintf(f, "*--sp = (Cell)");
+            aot_emit_ref(f, (Word *)body[i + 1], words, n, refs, nrefs);
+            fprintf(f, ";\n");
+        } else if (x == &word_tailcall || aot_find(words, n, x) >= 0) {
+            Word *callee = x == &word_tailcall ? (Word *)body[i + 1] : x;
+            int callee_k = aot_find(words, n, callee);
+            if (callee_k >= 0) {
+                fprintf(f, "aot_fn_%d();", callee_k);
+            } else {
+                fprintf(f, "call_word(");
+                aot_emit_ref(f, callee, words, n, refs, nrefs);
+                fprintf(f, ");");
+            }
+            fprintf(f, x == &word_tailcall ? " return;\n" : "\n");
+        } else if (c) {
+            fprintf(f, "%s\n", c);
+        } else {
+            fprintf(f, "call_word(");
+            aot_emit_ref(f, x, words, n, refs, nrefs);
+            fprintf(f, "); // %s\n", x->name);
+        }
+    }
+    if (target[length]) {
+        fprintf(f, "l%ld:\n    ;\n", (long)length);
+    }
+    fprintf(f, "}\n");
+    free(target);
+}
+
+int save_c(FILE *f) {
+    // write the translation unit, returns how many words went in it
+    static Word *all[AOT_MAX_WORDS];   // every word header in the dictionary, oldest first
+    static Word *words[AOT_MAX_WORDS]; // colon words among them
+    static Cell *ends[AOT_MAX_WORDS];  // where their bodies end
+    static char ok[AOT_MAX_WORDS];
+    static Word *refs[AOT_MAX_WORDS * 4];
+    int nall = 0, n = 0, nrefs = 0;
+
+    for (Word *w = latest; w != NULL && nall < AOT_MAX_WORDS; w = w->link) {
+        if (in_dictionary(w)) {
+            all[nall++] = w;
+        }
+    }
+    for (int i = 0; i < nall / 2; i++) {
+        Word *t = all[i];
+        all[i] = all[nall - 1 - i];
+        all[nall - 1 - i] = t;
+    }
+    for (int i = 0; i < nall; i++) {
+        if (is_docol(all[i]) && in_dictionary(all[i]->params)) {
+            ends[n] = aot_body_end(all[i], (Cell *)(i + 1 < nall ? (char *)all[i + 1] : here));
+            if (ends[n] != NULL) {
+                words[n++] = all[i];
+            }
+        }
+    }
+
+    // throw out words we can't translate until nothing changes, since that
+    // can leave words that used them with nothing to call
+    memset(ok, 1, n);
+    int changed = 1;
+    while (changed) {
+        changed = 0;
+        for (int k = 0; k < n; k++) {
+            if (ok[k] && !aot_check(words[k], ends[k], words, n, ok)) {
+                ok[k] = 0;
+                changed = 1;
+            }
+        }
+    }
+    int nok = 0;
+    for (int k = 0; k < n; k++) {
+        if (ok[k]) {
+            words[nok] = words[k];
+            ends[nok++] = ends[k];
+        }
+    }
+    n = nok;
+
+    fprintf(f, "// Generated by SAVE-C. Build it into riversforth with\n"
+               "//   gcc -O2 -DAOT_FILE='\"<this file>\"' riversforth.c\n\n");
+    for (int k = 0; k < n; k++) {
+        fprintf(f, "void aot_fn_%d(void);\n", k);
+    }
+    fprintf(f, "\n");
+    for (int k = 0; k < n; k++) {
+        fprintf(f, "Word aot_word_%d = { NULL, %d, ", k, (int)(words[k]->flags & F_IMMED));
+        aot_emit_string(f, words[k]->name);
+        fprintf(f, ", aot_fn_%d, NULL };\n", k);
+    }
+    fprintf(f, "\nextern Word *aot_refs[];\n");
+    for (int k = 0; k < n; k++) {
+        aot_emit_body(f, k, ends[k], words, n, refs, &nrefs);
+    }
+    fprintf(f, "\nWord *aot_refs[%d];\n", nrefs > 0 ? nrefs : 1);
+
+    fprintf(f, "\nvoid aot_register(void) {\n    static const char *names[] = {");
+    for (int r = 0; r < nrefs; r++) {
+        fprintf(f, r % 6 ? " " : "\n        ");
+        aot_emit_string(f, refs[r]->name);
+        fprintf(f, ",");
+    }
+    fprintf(f, "\n        NULL\n    };\n"
+               "    for (int r = 0; names[r] != NULL; r++) {\n"
+               "        aot_refs[r] = find(names[r]);\n"
+               "        if (aot_refs[r] == NULL) {\n"
+               "            fprintf(stderr, \"%%s isn't defined\\n\", names[r]);\n"
+               "            exit(1);\n"
+               "        }\n"
+               "    }\n");
+    for (int k = 0; k < n; k++) {
+        fprintf(f, "    add_word(&aot_word_%d);\n", k);
+    }
+    fprintf(f, "}\n");
+    return n;
+}
+
+void do_save_c(void) {
+    // SAVE-C <file>, write colon words out as C
+    char *filename = word_string();
+    FILE *f = fopen(filename, "w");
+    if (f == NULL) {
+        output_printf("%s: %s\n", filename, strerror(errno));
+    } else {
+        int n = save_c(f);
+        if (ferror(f) | fclose(f)) {
+            output_printf("couldn't write %s\n", filename);
+        } else {
+            output_printf("%d words written to %s\n", n, filename);
+        }
+    }
+    free(filename);
+}
+
+Word word_save_c = { NULL, 0, "SAVE-C", do_save_c, NULL };
+
+#if SAMPLER
+// Sampling profiler.
+//
+// RIVERSFORTH_SAMPLE=<samples per second> in the environment starts a SIGPROF
+// timer. Each tick the handler copies current_word, ip and the return stack
+// (every colon word that's running has its return address there) into samples.
+// The handler only claims a slot with an atomic add and copies, no locks or
+// malloc, and drops samples if the buffer is full. Once it is half full the
+// next docol (or word the interpreter reads) calls sample_collect(), which
+// turns each saved ip back into the colon word it is in and adds the stacks
+// up, so a long run keeps being sampled. SAMPLE-DUMP (and exit) write them to
+// RIVERSFORTH_SAMPLE_FILE (riversforth.folded by default) as "outer;inner;word
+// count" lines, ready for flamegraph.pl.
+// The goto version of run() keeps ip and rp in locals, so with THREADED_GOTO
+// the samples only know current_word, which it sets for words it calls.
+#define SAMPLE_DEPTH 64    // deepest return stack kept per sample
+
+typedef struct {
+    Word *word;
+    Cell *ip;
+    int depth;
+    Cell frames[SAMPLE_DEPTH]; // return stack, newest first
+} Sample;
+Sample samples[SAMPLE_COUNT];
+uint64_t sample_next = 0;    // next slot, claimed by the handler
+uint64_t sample_dropped = 0; // ticks that found the buffer full
+int sample_running = 0;
+const char *sample_file = "riversforth.folded";
+
+typedef struct {
+    char *stack;
+    uint64_t count;
+} SampleStack;
+SampleStack *sample_stacks = NULL; // everything dumped so far, added up
+size_t sample_nstacks = 0;
+size_t *sample_table = NULL; // hash table of 1 + index into sample_stacks, 0 = empty
+size_t sample_table_size = 0; // always a power of 2, at least twice sample_nstacks
+
+// colon words sorted by where their bodies start, so sample_word_at() can
+// binary search them; sample_collect() sorts them again each time
+Word **sample_bodies = NULL;
+size_t sample_nbodies = 0;
+
+void sample_handler(int sig) {
+    uint64_t i = __atomic_fetch_add(&sample_next, 1, __ATOMIC_RELAXED);
+    if (i >= SAMPLE_COUNT) {
+        __atomic_fetch_add(&sample_dropped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    Sample *s = &samples[i];
+    Cell *r = rp;
+    int depth = 0;
+    if (r >= return_stack && r <= r0) {
+        while (r < r0 && depth < SAMPLE_DEPTH) {
+            s->frames[depth++] = *r++;
+        }
+    }
+    s->word = current_word;
+    s->ip = ip;
+    s->depth = depth;
+}
+
+int sample_body_cmp(const void *a, const void *b) {
+    Cell *x = (*(Word **)a)->params, *y = (*(Word **)b)->params;
+    return x < y ? -1 : x > y;
+}
+
+void sample_sort_bodies(void) {
+    sample_nbodies = 0;
+    for (Word *w = latest; w != NULL; w = w->link) {
+        if (!is_docol(w) || w->params == NULL) {
+            continue;
+        }
+        if ((sample_nbodies & (sample_nbodies - 1)) == 0) {
+            Word **more = realloc(sample_bodies, (sample_nbodies ? sample_nbodies * 2 : 64) * sizeof(Word *));
+            if (more == NULL) break; // the words not in it just don't show up
+            sample_bodies = more;
+        }
+        sample_bodies[sample_nbodies++] = w;
+    }
+    qsort(sample_bodies, sample_nbodies, sizeof(Word *), sample_body_cmp);
+}
+
+Word *sample_word_at(Cell *addr) {
+    // the colon word whose body addr is in, or NULL; bodies come right after
+    // their word so it's the one starting closest below addr.
+    // Needs sample_sort_bodies() since the last definition.
+    if (addr == NULL) {
+        return NULL;
+    }
+    size_t low = 0, high = sample_nbodies; // bodies before low start at or below addr
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if ((Cell *)sample_bodies[mid]->params <= addr) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    if (low == 0) {
+        return NULL;
+    }
+    Word *best = sample_bodies[low - 1];
+    if (!in_dictionary(addr) && addr - (Cell *)best->params > INLINE_SCAN_MAX) {
+        return NULL; // not in a static body either, probably something >R put there
+    }
+    return best;
+}
+
+void sample_add(const char *stack) {
+    size_t length = strlen(stack);
+    if (sample_nstacks * 2 >= sample_table_size) {
+        size_t size = sample_table_size ? sample_table_size * 2 : 256;
+        size_t *table = calloc(size, sizeof(size_t));
+        if (table == NULL) {
+            return; // drop it rather than lose count of the rest
+        }
+        for (size_t i = 0; i < sample_nstacks; i++) {
+            const char *s = sample_stacks[i].stack;
+            size_t b = name_hash(s, strlen(s)) & (size - 1);
+            while (table[b]) b = (b + 1) & (size - 1);
+            table[b] = i + 1;
+        }
+        free(sample_table);
+        sample_table = table;
+        sample_table_size = size;
+    }
+    size_t b = name_hash(stack, length) & (sample_table_size - 1);
+    for (; sample_table[b]; b = (b + 1) & (sample_table_size - 1)) {
+        SampleStack *s = &sample_stacks[sample_table[b] - 1];
+        if (strcmp(s->stack, stack) == 0) {
+            s->count++;
+            return;
+        }
+    }
+    if ((sample_nstacks & (sample_nstacks - 1)) == 0) {
+        sample_stacks = realloc(sample_stacks,
+                                (sample_nstacks ? sample_nstacks * 2 : 64) * sizeof(SampleStack));
+    }
+    sample_stacks[sample_nstacks++] = (SampleStack){ strdup(stack), 1 };
+    sample_table[b] = sample_nstacks;
+}
+
+void sample_clear(void) {
+    // forget everything added up so far
+    for (size_t i = 0; i < sample_nstacks; i++) {
+        free(sample_stacks[i].stack);
+    }
+    free(sample_stacks);
+    free(sample_table);
+    sample_stacks = NULL;
+    sample_nstacks = 0;
+    sample_table = NULL;
+    sample_table_size = 0;
+}
+
+void sample_collect(void) {
+    // add up the samples taken since last time and empty the buffer
+    sigset_t block, old;
+    sigemptyset(&block);
+    sigaddset(&block, SIGPROF);
+    sigprocmask(SIG_BLOCK, &block, &old);
+
+    uint64_t n = sample_next < SAMPLE_COUNT ? sample_next : SAMPLE_COUNT;
+    if (n > 0) {
+        sample_sort_bodies();
+    }
+    char stack[SAMPLE_DEPTH * 40];
+    for (uint64_t i = 0; i < n; i++) {
+        Sample *s = &samples[i];
+        size_t len = 0;
+        stack[0] = '\0';
+        Word *inner = NULL;
+        // oldest return address first, then the word ip is in, then the word running
+        for (int d = s->depth; d >= 0; d--) {
+            Word *w = sample_word_at(d > 0 ? (Cell *)s->frames[d - 1] : s->ip);
+            if (w) {
+                len += snprintf(stack + len, sizeof(stack) - len, "%s%s", len ? ";" : "", w->name);
+                inner = w;
+            }
+            if (len >= sizeof(stack) - 40) break;
+        }
+        if (s->word && s->word != inner && len < sizeof(stack) - 40) {
+            snprintf(stack + len, sizeof(stack) - len, "%s%s", len ? ";" : "",
+                     s->word->name ? s->word->name : "?");
+        }
+        sample_add(stack[0] ? stack : "[interpreter]");
+    }
+    sample_next = 0;
+
+    sigprocmask(SIG_SETMASK, &old, NULL);
+}
+
+void sample_write(void) {
+    sample_collect();
+    FILE *f = fopen(sample_file, "w");
+    if (f == NULL) {
+        perror(sample_file);
+        return;
+    }
+    for (size_t i = 0; i < sample_nstacks; i++) {
+        fprintf(f, "%s %llu\n", sample_stacks[i].stack, (unsigned long long)sample_stacks[i].count);
+    }
+    fclose(f);
+    if (sample_dropped) {
+        fprintf(stderr, "%llu samples dropped, dump more often\n", (unsigned long long)sample_dropped);
+    }
+}
+
+void do_sample_dump(void) {
+    // SAMPLE-DUMP, write out everything sampled so far
+    sample_write();
+}
+
+Word word_sample_dump = { NULL, 0, "SAMPLE-DUMP", do_sample_dump, NULL };
+
+void sample_start(void) {
+    // start sampling if RIVERSFORTH_SAMPLE is set
+    const char *rate = getenv("RIVERSFORTH_SAMPLE");
+    if (rate == NULL) {
+        return;
+    }
+    long hz = atol(rate);
+    if (hz <= 0 || hz > 1000000) {
+        hz = 997; // not quite 1000 so it doesn't keep step with anything periodic
+    }
+    if (getenv("RIVERSFORTH_SAMPLE_FILE")) {
+        sample_file = getenv("RIVERSFORTH_SAMPLE_FILE");
+    }
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = sample_handler;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGPROF, &sa, NULL);
+    struct itimerval timer;
+    timer.it_interval.tv_sec = 0;
+    timer.it_interval.tv_usec = 1000000 / hz;
+    timer.it_value = timer.it_interval;
+    setitimer(ITIMER_PROF, &timer, NULL);
+    sample_running = 1;
+    atexit(sample_write);
+}
+#endif
+
+void do_interpret(void) {
+    while (words_remain()) {
+        SAMPLE_DRAIN();
+        do_word();
+        size_t length = sp[0];
+        char *word = (char *)sp[1];
+        do_find();
+        Word *w = (Word *)pop();
+        if (w) {
+            if ((w->flags & F_IMMED) || state == 0) {
+                // run it now
+                fold_count = 0; // an immediate word like THEN can make the next cell a branch target
+                if (w->code == docol) {
+                    run(w);
+                } else {
+                    current_word = w;
+#if PROFILE
+                    prof_dispatch(w);
+#else
+                    w->code();
+#endif
+                }
+            } else if (!fold_constant(w)) {
+                compile_word(w, 0);
+            }
+        } else {
+            // Not found — try to parse number
+            push((Cell)word);
+            push(length);
+            do_number();
+            Cell unparsed = pop();
+            Cell number = pop();
+            if (unparsed == 0) {
+                if (state == 0) {
+                    push(number);
+                } else {
+                    Cell *lit = (Cell *)here;
+                    push((Cell)&word_lit);
+                    do_comma();
+                    push(number);
+                    do_comma();
+                    fold_literal(lit);
+                }
+            } else {
+                output_printf("Unknown word: %.*s\n", (int)length, word);
+            }
+        }
+    }
+}
+
+void interpret_all(void) {
+    // every line of input, without prompts
+    do {
+        do_interpret();
+    } while (skip_line());
+}
+
+void interpret(char *s) {
+    InputSource saved = input;
+    input = (InputSource){ s, 0, strlen(s), 0, -1, 0 };
+    interpret_all();
+    input = saved;
+}
+
+// Stacks, dictionary and data space with guard pages.
+//
+// Each stack is mmap'd with a PROT_NONE page below and above it. Pushing past
+// the bottom or popping past the top touches a guard page, and stack_fault,
+// running on its own signal stack since the fault could be anywhere, turns the
+// SIGSEGV into a Forth error: forth_error resets the stacks and jumps back to
+// the interpreter through error_jmp. Any other SIGSEGV crashes as usual.
+// CREATE, , and ALLOT check for room themselves, the guard pages after the
+// dictionary and data space catch anything that writes past HERE by hand.
+size_t page_size;
+sigjmp_buf *error_jmp = NULL;      // where an error goes, NULL = print it and exit
+const char *error_message = NULL; // what it was
+
+void forth_error(const char *what) {
+    if (error_jmp == NULL) {
+        fprintf(stderr, "%s\n", what);
+        exit(1);
+    }
+    error_message = what;
+    sp = s0;
+    rp = r0;
+    ip = NULL;
+    state = 0; // an unfinished definition stays hidden
+#if PROFILE
+    for (int i = 0; i < prof_depth && i < PROF_DEPTH; i++) {
+        prof_frames[i].word->prof_active = 0;
+    }
+    prof_depth = 0;
+#endif
+    siglongjmp(*error_jmp, 1);
+}
+
+char *map_guarded(size_t *bytes, const char *what) {
+    // mmap *bytes, rounded up to whole pages, between guard pages; returns the
+    // start and updates *bytes to what we got. MAP_NORESERVE so the big
+    // reservations only cost what gets touched.
+    *bytes = (*bytes + page_size - 1) / page_size * page_size;
+    char *m = mmap(NULL, *bytes + 2 * page_size, PROT_NONE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (m == MAP_FAILED || mprotect(m + page_size, *bytes, PROT_READ | PROT_WRITE) != 0) {
+        fprintf(stderr, "can't map %s: %s\n", what, strerror(errno));
+        exit(1);
+    }
+    return m + page_size;
+}
+
+Cell *map_stack(size_t *cells, size_t spare) {
+    // *cells + spare cells (the extra goes at the top, between the stack and
+    // the top guard page); updates *cells to what we got
+    size_t bytes = (*cells + spare) * sizeof(Cell);
+    Cell *stack = (Cell *)map_guarded(&bytes, "stack");
+    *cells = bytes / sizeof(Cell) - spare;
+    return stack;
+}
+
+int in_page(void *addr, void *page) {
+    return (char *)addr >= (char *)page && (char *)addr < (char *)page + page_size;
+}
+
+void stack_fault(int sig, siginfo_t *info, void *context) {
+    void *addr = info->si_addr;
+    const char *what = NULL;
+    if (in_page(addr, (char *)data_stack - page_size)) {
+        what = "data stack overflow";
+    } else if (in_page(addr, data_stack + data_stack_size + TOS_CACHE)) {
+        what = "data stack underflow";
+    } else if (in_page(addr, (char *)return_stack - page_size)) {
+        what = "return stack overflow";
+    } else if (in_page(addr, return_stack + return_stack_size)) {
+        what = "return stack underflow";
+    } else if (in_page(addr, dictionary + dictionary_size)) {
+        what = "dictionary full";
+    } else if (in_page(addr, data_space + data_space_size)) {
+        what = "data space full";
+    }
+    if (what == NULL || error_jmp == NULL) {
+        signal(SIGSEGV, SIG_DFL); // not ours, fault again and crash as usual
+        return;
+    }
+    forth_error(what);
+}
+
+void stacks_init(void) {
+    page_size = sysconf(_SC_PAGESIZE);
+    // with TOS_CACHE, one spare cell above the top of the data stack: run()
+    // loads the top of the stack into a local when it starts, even when the
+    // stack is empty. Otherwise the top is right against the guard page, so
+    // popping one cell too many is an underflow.
+    data_stack = map_stack(&data_stack_size, TOS_CACHE);
+    sp = data_stack + data_stack_size;
+    return_stack = map_stack(&return_stack_size, 0);
+    rp = return_stack + return_stack_size;
+
+    static char signal_stack[64 * 1024];
+    stack_t ss = { .ss_sp = signal_stack, .ss_size = sizeof(signal_stack), .ss_flags = 0 };
+    sigaltstack(&ss, NULL);
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_sigaction = stack_fault;
+    sa.sa_flags = SA_SIGINFO | SA_ONSTACK | SA_NODEFER;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGSEGV, &sa, NULL);
+}
+
+void dictionary_init(void) {
+    // after stacks_init(), which finds out the page size
+    dictionary = map_guarded(&dictionary_size, "dictionary");
+    data_space = map_guarded(&data_space_size, "data space");
+#ifdef MADV_HUGEPAGE
+    if (huge_pages) {
+        // only a hint: the kernel may or may not find 2 MB pages for them
+        madvise(dictionary, dictionary_size, MADV_HUGEPAGE);
+        madvise(data_space, data_space_size, MADV_HUGEPAGE);
+    }
+#endif
+    here = dictionary;
+    data_here = data_space;
+}
+
+// Dictionary images.
+//
+// SAVE-IMAGE <file> writes out everything defined since startup, the part of
+// the dictionary and data space between image_base_here/image_base_data and
+// here/data_here, and --image <file> maps it back in when riversforth starts,
+// so a vocabulary gets compiled once instead of on every run.
+//
+// The file is a header page, then the dictionary part, then the data space
+// part (each whole pages, so they can be mmap'd copy-on-write straight from
+// the file), then a table of primitive names and a list of relocations.
+// Saving scans every cell of both parts for
+//   - a built in word (or docol, or a VARIABLE's code) -> its index in the
+//     primitive table, looked up by name again when loading, so the image
+//     doesn't care where the binary got loaded,
+//   - an address in either saved part -> moved by however far the part moved,
+//   - the word that was latest at startup, which the oldest saved word links
+//     to -> whatever is latest at startup when loading.
+// A number that happens to look like one of those gets "relocated" too, which
+// is why a literal address of a C variable (as opposed to a word) is left
+// alone and won't mean anything in the next run. JIT compiled words are saved
+// threaded and stay that way when loaded.
+#define IMAGE_MAGIC "RFIMAGE1"
+enum { IMAGE_PRIM, IMAGE_ARENA, IMAGE_BASE }; // relocation kinds
+
+typedef struct {
+    char magic[8];
+    uint64_t page_size;
+    uint64_t word_size;       // sizeof(Word), which depends on the switches
+    uint64_t dict_start;      // where the saved part of the dictionary was ...
+    uint64_t dict_used;       // ... and how much of it there was
+    uint64_t data_start;
+    uint64_t data_used;
+    uint64_t dict_offset;     // file offsets, the first two page aligned
+    uint64_t data_offset;
+    uint64_t prims_offset;
+    uint64_t relocs_offset;
+    uint64_t nprims;
+    uint64_t nrelocs;
+    uint64_t latest;          // raw or relocated like any other cell
+    uint64_t latest_kind;     // one of the relocation kinds, or -1 for a plain pointer
+    uint64_t base;
+} ImageHeader;
+
+// startup state that images are saved relative to and loaded on top of
+Word *image_base_latest;
+char *image_base_here;
+char *image_base_data;
+const char *image_file = NULL; // --image
+
+Cell image_prim(const char *name) {
+    // the address a primitive table entry stands for in this binary, or 0
+    if (strcmp(name, "(docol)") == 0) return (Cell)docol;
+    if (strcmp(name, "(dovar)") == 0) return (Cell)do_dovar;
+    for (Word *w = latest; w != NULL; w = w->link) {
+        if (!in_dictionary(w) && strcmp(w->name, name) == 0) return (Cell)w;
+    }
+    for (size_t i = 0; i < sizeof(hidden_words) / sizeof(hidden_words[0]); i++) {
+        if (strcmp(hidden_words[i]->name, name) == 0) return (Cell)hidden_words[i];
+    }
+    return 0;
+}
+
+typedef struct {
+    Cell *prims;      // addresses that are primitives ...
+    const char **names; // ... and their names
+    size_t nprims;
+    uint64_t *relocs; // offset in the part << 3 | which part << 2 | kind
+    size_t nrelocs;
+} ImageRelocs;
+
+int image_kind(Cell v, Cell *index, ImageRelocs *r) {
+    // how to save cell value v: one of the kinds (and the primitive index), or -1
+    for (size_t i = 0; i < r->nprims; i++) {
+        if (r->prims[i] == v) {
+            *index = i;
+            return IMAGE_PRIM;
+        }
+    }
+    if ((v >= (Cell)image_base_here && v <= (Cell)here)
+            || (v >= (Cell)image_base_data && v <= (Cell)data_here)) {
+        return IMAGE_ARENA;
+    }
+    if (v == (Cell)image_base_latest && in_dictionary(image_base_latest)) {
+        return IMAGE_BASE;
+    }
+    return -1;
+}
+
+void image_scan(char *copy, char *start, size_t used, int part, ImageRelocs *r) {
+    // find the cells that need relocating in copy, which is a copy of used bytes
+    // from start, whose page starts at copy
+    size_t skip = (uintptr_t)start & (page_size - 1);
+    for (size_t off = (skip + sizeof(Cell) - 1) & -sizeof(Cell); off + sizeof(Cell) <= skip + used; off += sizeof(Cell)) {
+        Cell *c = (Cell *)(copy + off);
+        Cell index;
+        int kind = image_kind(*c, &index, r);
+        if (kind < 0) continue;
+        if (kind == IMAGE_PRIM) *c = index;
+        r->relocs[r->nrelocs++] = (uint64_t)off << 3 | part << 2 | kind;
+    }
+}
+
+int save_image(FILE *f) {
+    // write the image, returns how many words went in it, or -1
+    size_t dict_skip = (uintptr_t)image_base_here & (page_size - 1);
+    size_t data_skip = (uintptr_t)image_base_data & (page_size - 1);
+    size_t dict_used = (char *)here - image_base_here;
+    size_t data_used = (char *)data_here - image_base_data;
+    size_t dict_pages = (dict_skip + dict_used + page_size - 1) & -page_size;
+    size_t data_pages = (data_skip + data_used + page_size - 1) & -page_size;
+    char *dict_copy = calloc(1, dict_pages + page_size);
+    char *data_copy = calloc(1, data_pages + page_size);
+    ImageRelocs r = { 0 };
+    r.relocs = malloc((dict_pages + data_pages) / sizeof(Cell) * sizeof(uint64_t) + 1);
+
+    // primitive table: every built in word, plus docol and VARIABLE's code
+    size_t max_prims = 2 + sizeof(hidden_words) / sizeof(hidden_words[0]);
+    for (Word *w = latest; w != NULL; w = w->link) max_prims++;
+    r.prims = malloc(max_prims * sizeof(Cell));
+    r.names = malloc(max_prims * sizeof(char *));
+    int result = -1;
+    if (!dict_copy || !data_copy || !r.relocs || !r.prims || !r.names) goto done;
+    r.prims[r.nprims] = (Cell)docol;
+    r.names[r.nprims++] = "(docol)";
+    r.prims[r.nprims] = (Cell)do_dovar;
+    r.names[r.nprims++] = "(dovar)";
+    for (Word *w = latest; w != NULL; w = w->link) {
+        if (!in_dictionary(w)) {
+            r.prims[r.nprims] = (Cell)w;
+            r.names[r.nprims++] = w->name;
+        }
+    }
+    for (size_t i = 0; i < sizeof(hidden_words) / sizeof(hidden_words[0]); i++) {
+        r.prims[r.nprims] = (Cell)hidden_words[i];
+        r.names[r.nprims++] = hidden_words[i]->name;
+    }
+
+    memcpy(dict_copy + dict_skip, image_base_here, dict_used);
+    memcpy(data_copy + data_skip, image_base_data, data_used);
+    // tidy the saved words' headers: native code goes back to threaded, and
+    // the hash links and dispatch caches get rebuilt when loading anyway
+    result = 0;
+    for (Word *w = latest; w != NULL && (char *)w >= image_base_here && (char *)w < (char *)here; w = w->link) {
+        Word *saved = (Word *)(dict_copy + dict_skip + ((char *)w - image_base_here));
+        if (saved->flags & F_JIT) {
+            saved->flags &= ~F_JIT;
+            saved->code = docol;
+        }
+        saved->hash_link = NULL;
+#if THREADED_GOTO
+        saved->op = 0;
+#endif
+#if PROFILE
+        saved->prof_count = saved->prof_self = saved->prof_total = saved->prof_active = 0;
+#endif
+        result++;
+    }
+    image_scan(dict_copy, image_base_here, dict_used, 0, &r);
+    image_scan(data_copy, image_base_data, data_used, 1, &r);
+
+    ImageHeader h = { IMAGE_MAGIC };
+    h.page_size = page_size;
+    h.word_size = sizeof(Word);
+    h.dict_start = (uintptr_t)image_base_here;
+    h.dict_used = dict_used;
+    h.data_start = (uintptr_t)image_base_data;
+    h.data_used = data_used;
+    h.dict_offset = page_size;
+    h.data_offset = h.dict_offset + dict_pages;
+    h.prims_offset = h.data_offset + data_pages;
+    h.nprims = r.nprims;
+    h.nrelocs = r.nrelocs;
+    Cell index;
+    h.latest_kind = image_kind((Cell)latest, &index, &r);
+    h.latest = h.latest_kind == IMAGE_PRIM ? (uint64_t)index : (uint64_t)(Cell)latest;
+    h.base = base;
+    size_t names_size = 0;
+    for (size_t i = 0; i < r.nprims; i++) names_size += strlen(r.names[i]) + 1;
+    h.relocs_offset = (h.prims_offset + names_size + 7) & -(uint64_t)8;
+
+    char *zeros = calloc(1, page_size);
+    int ok = zeros != NULL
+        && fwrite(&h, sizeof(h), 1, f) == 1
+        && fwrite(zeros, page_size - sizeof(h), 1, f) == 1
+        && fwrite(dict_copy, 1, dict_pages, f) == dict_pages
+        && fwrite(data_copy, 1, data_pages, f) == data_pages;
+    for (size_t i = 0; ok && i < r.nprims; i++) {
+        ok = fwrite(r.names[i], strlen(r.names[i]) + 1, 1, f) == 1;
+    }
+    ok = ok && fwrite(zeros, 1, h.relocs_offset - h.prims_offset - names_size, f) == h.relocs_offset - h.prims_offset - names_size
+        && fwrite(r.relocs, sizeof(uint64_t), r.nrelocs, f) == r.nrelocs;
+    free(zeros);
+    if (!ok) result = -1;
+
+done:
+    free(dict_copy);
+    free(data_copy);
+    free(r.relocs);
+    free(r.prims);
+    free(r.names);
+    return result;
+}
+
+void do_save_image(void) {
+    // SAVE-IMAGE <file>, for --image
+    char *filename = word_string();
+    FILE *f = fopen(filename, "wb");
+    if (f == NULL) {
+        output_printf("%s: %s\n", filename, strerror(errno));
+    } else {
+        int n = save_image(f);
+        if ((ferror(f) | fclose(f)) || n < 0) {
+            output_printf("couldn't write %s\n", filename);
+        } else {
+            output_printf("%d words written to %s\n", n, filename);
+        }
+    }
+    free(filename);
+}
+
+Word word_save_image = { NULL, 0, "SAVE-IMAGE", do_save_image, NULL };
+
+const char *load_image(const char *filename) {
+    // map an image in after whatever is defined now; returns NULL or what went wrong
+    ImageHeader h;
+    const char *error = NULL;
+    char *names = NULL;
+    Cell *prims = NULL;
+    uint64_t *relocs = NULL;
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) return strerror(errno);
+    if (pread(fd, &h, sizeof(h), 0) != sizeof(h) || memcmp(h.magic, IMAGE_MAGIC, 8) != 0) {
+        error = "not an image";
+        goto done;
+    }
+    if (h.page_size != page_size || h.word_size != sizeof(Word)) {
+        error = "image was saved by a different build";
+        goto done;
+    }
+    // nothing in the header gets used without checking it against the file,
+    // so a broken image can't make us write outside the parts we map
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        error = strerror(errno);
+        goto done;
+    }
+    uint64_t file_size = st.st_size;
+    if (h.dict_offset != page_size || h.data_offset < h.dict_offset || h.prims_offset < h.data_offset
+            || h.relocs_offset < h.prims_offset || h.relocs_offset > file_size
+            || (h.data_offset & (page_size - 1)) || (h.prims_offset & (page_size - 1))
+            || h.nrelocs > (file_size - h.relocs_offset) / sizeof(uint64_t)
+            || h.nprims > h.relocs_offset - h.prims_offset // at least a NUL each
+            || (h.dict_start & (page_size - 1)) + h.dict_used > h.data_offset - h.dict_offset
+            || (h.data_start & (page_size - 1)) + h.data_used > h.prims_offset - h.data_offset) {
+        error = "image is corrupt";
+        goto done;
+    }
+
+    // the primitives it uses have to be in this binary too
+    size_t names_size = h.relocs_offset - h.prims_offset;
+    names = malloc(names_size + 1);
+    prims = malloc(h.nprims * sizeof(Cell) + 1);
+    relocs = malloc(h.nrelocs * sizeof(uint64_t) + 1);
+    if (!names || !prims || !relocs) {
+        error = "out of memory";
+        goto done;
+    }
+    if (pread(fd, names, names_size, h.prims_offset) != (ssize_t)names_size
+            || pread(fd, relocs, h.nrelocs * sizeof(uint64_t), h.relocs_offset) != (ssize_t)(h.nrelocs * sizeof(uint64_t))) {
+        error = "image is truncated";
+        goto done;
+    }
+    names[names_size] = '\0';
+    char *name = names;
+    for (size_t i = 0; i < h.nprims; i++) {
+        if (name >= names + names_size) {
+            error = "image is corrupt";
+            goto done;
+        }
+        prims[i] = image_prim(name);
+        if (prims[i] == 0) {
+            fprintf(stderr, "image needs %s\n", name);
+            error = "image uses words this build doesn't have";
+            goto done;
+        }
+        name += strlen(name) + 1;
+    }
+
+    // each part goes at the same offset into a page as it was saved from, in
+    // the first page after here / data_here, so moving it is a whole number of pages
+    size_t dict_skip = h.dict_start & (page_size - 1);
+    size_t data_skip = h.data_start & (page_size - 1);
+    size_t dict_pages = h.data_offset - h.dict_offset;
+    size_t data_pages = h.prims_offset - h.data_offset;
+    char *dict_page = (char *)(((uintptr_t)here + page_size - 1) & -page_size);
+    char *data_page = (char *)(((uintptr_t)data_here + page_size - 1) & -page_size);
+    if (dict_page + dict_pages > dictionary + dictionary_size
+            || data_page + data_pages > data_space + data_space_size) {
+        error = "image doesn't fit";
+        goto done;
+    }
+    for (size_t i = 0; i < h.nrelocs; i++) {
+        uint64_t offset = relocs[i] >> 3;
+        size_t part_size = relocs[i] >> 2 & 1 ? data_pages : dict_pages;
+        if (part_size < sizeof(Cell) || offset > part_size - sizeof(Cell) || offset % sizeof(Cell)
+                || (relocs[i] & 3) > IMAGE_BASE) {
+            error = "image is corrupt";
+            goto done;
+        }
+    }
+    if ((h.latest_kind == IMAGE_PRIM && h.latest >= h.nprims)
+            || (h.latest_kind == IMAGE_ARENA
+                && (h.latest < h.dict_start || h.latest + sizeof(Word) > h.dict_start + h.dict_used))
+            || h.latest_kind > IMAGE_BASE) {
+        error = "image is corrupt";
+        goto done;
+    }
+    if ((dict_pages && mmap(dict_page, dict_pages, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, h.dict_offset) == MAP_FAILED)
+            || (data_pages && mmap(data_page, data_pages, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, h.data_offset) == MAP_FAILED)) {
+        error = strerror(errno);
+        goto unmap;
+    }
+    Cell dict_delta = (Cell)(dict_page + dict_skip) - (Cell)h.dict_start;
+    Cell data_delta = (Cell)(data_page + data_skip) - (Cell)h.data_start;
+    for (size_t i = 0; i < h.nrelocs; i++) {
+        Cell *c = (Cell *)((relocs[i] >> 2 & 1 ? data_page : dict_page) + (relocs[i] >> 3));
+        switch (relocs[i] & 3) {
+        case IMAGE_PRIM:
+            if ((uint64_t)*c >= h.nprims) {
+                error = "image is corrupt";
+                goto unmap;
+            }
+            *c = prims[*c];
+            break;
+        case IMAGE_ARENA:
+            if ((uint64_t)*c >= h.dict_start && (uint64_t)*c <= h.dict_start + h.dict_used) {
+                *c += dict_delta;
+            } else {
+                *c += data_delta;
+            }
+            break;
+        case IMAGE_BASE:
+            *c = (Cell)latest;
+            break;
+        }
+    }
+
+    // the saved words have to chain back to what was latest before, each
+    // with its name straight after it, or the first FIND would go astray
+    Word *loaded_latest = latest;
+    switch ((int)h.latest_kind) {
+    case IMAGE_PRIM:  loaded_latest = (Word *)prims[h.latest]; break;
+    case IMAGE_ARENA: loaded_latest = (Word *)(h.latest + dict_delta); break;
+    }
+    char *loaded_start = dict_page + dict_skip;
+    char *loaded_end = loaded_start + h.dict_used;
+    for (Word *w = loaded_latest; w != latest && (in_dictionary(w) || !is_word(w)); w = w->link) {
+        if ((char *)w < loaded_start || (char *)(w + 1) >= loaded_end || (uintptr_t)w % sizeof(Cell)
+                || w->name != (char *)(w + 1) || memchr(w->name, '\0', loaded_end - w->name) == NULL
+                || ((char *)w->link >= (char *)w && (char *)w->link < loaded_end)) {
+            error = "image is corrupt";
+            goto unmap;
+        }
+    }
+    latest = loaded_latest;
+    here = loaded_end;
+    data_here = data_page + data_skip + h.data_used;
+    base = h.base;
+    // dict_lookup() notices latest changed and rebuilds the hash index
+    goto done;
+
+unmap:
+    // put plain memory back where the image was mapped, rather than leave
+    // parts of the file there for the next definitions to land on
+    mmap(dict_page, dict_pages, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_NORESERVE, -1, 0);
+    mmap(data_page, data_pages, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_NORESERVE, -1, 0);
+
+done:
+    free(names);
+    free(prims);
+    free(relocs);
+    close(fd);
+    return error;
+}
+
+// Loading source files and the fork server.
+//
+// Files named on the command line are interpreted in order before anything is
+// read from stdin. With --fork-server <path>, riversforth then listens on a
+// Unix socket instead, and forks a child for each connection. The child has
+// the dictionary the files built (copy-on-write, so nothing gets compiled
+// again) and runs the usual interpreter with the connection as its stdin and
+// stdout, so each job is its own process and can't disturb the next one.
+
+int load_file(const char *path) {
+    // interpret a file as if it had been typed in, returns 0 if it can't be read
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror(path);
+        return 0;
+    }
+    InputSource saved = input;
+    input = input_from_fd(fd);
+    interpret_all();
+    input_close(&input);
+    input = saved;
+    close(fd);
+    return 1;
 }
 
-void run(Word *start) {
-    // push NULL (current IP which is initially NULL or NULL itself?)
-    // docol only pushes what we set ip to here which is the next word
-    // in the params we're running
-    rp--;
-    *rp = (Cell)ip;
-    ip = (Cell *)start->params;
-    while (ip != NULL) {
-        current_word = (Word *)*ip;
-        ip++;
-        current_word->code();
+int load_source_files(const char **files, int n) {
+    // load each file in turn, returns the exit status: 1, with a message
+    // saying which file, if one can't be read or stops with an error
+    static sigjmp_buf load_jmp;
+    static int loading; // which file, static so it survives the longjmp
+    static sigjmp_buf *saved_jmp;
+    saved_jmp = error_jmp;
+    if (sigsetjmp(load_jmp, 1)) {
+        fprintf(stderr, "%s: %s\n", files[loading], error_message);
+        error_jmp = saved_jmp;
+        return 1;
+    }
+    error_jmp = &load_jmp;
+    for (loading = 0; loading < n; loading++) {
+        if (!load_file(files[loading])) {
+            error_jmp = saved_jmp;
+            return 1;
+        }
     }
+    error_jmp = saved_jmp;
+    return 0;
 }
 
-Word *find(const char *name) {
-    for (Word *w = latest; w != NULL; w = w->link) {
-        if (strcasecmp(w->name, name) == 0) {
-            return w;
+void fork_server(const char *path) {
+    // only returns in a child, with stdin and stdout connected to a client
+    int server = socket(AF_UNIX, SOCK_STREAM, 0);
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "%s: socket path too long\n", path);
+        exit(1);
+    }
+    strcpy(addr.sun_path, path);
+    unlink(path); // left over from a server that's gone
+    if (server < 0 || bind(server, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(server, 64) != 0) {
+        perror(path);
+        exit(1);
+    }
+    signal(SIGCHLD, SIG_IGN); // nobody waits for the children, don't keep zombies
+    output_flush();
+    while (1) {
+        int client = accept(server, NULL, NULL);
+        if (client < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            perror("accept");
+            exit(1);
         }
+        pid_t pid = fork();
+        if (pid == 0) {
+            close(server);
+            dup2(client, 0);
+            dup2(client, 1);
+            close(client);
+            output_line_flush = 1; // output goes back a line at a time
+            return;
+        }
+        if (pid < 0) {
+            perror("fork");
+        }
+        close(client);
     }
-    return NULL;
 }
 
-char *get_token(char **input_ptr) {
-    static char token[TOKEN_SIZE];
-    char *in = *input_ptr;
-    char *out = token;
-
-    // Skip whitespace
-    while (*in && isspace(*in)) in++;
+#ifdef AOT_FILE
+#include AOT_FILE
+#endif
 
-    // Copy next word
-    while (*in && !isspace(*in)) {
-        *out++ = *in++;
+#if STATS
+// The deepest the stacks have been is found by painting them with a pattern at
+// startup and looking for the furthest cell that doesn't have it any more, so
+// push and pop don't have to keep track. Only the pages the stacks have used
+// already and the STACK_PAINT_PAGES below them get painted, painting the rest
+// would have the kernel find memory for all of them (--data-stack can reserve
+// gigabytes). Below that mincore() tells which pages have been touched since,
+// so depths there are to the page.
+#define STACK_PAINT ((Cell)0x5AFEC0DE5AFEC0DE)
+#define STACK_PAINT_PAGES 16
+Cell *data_painted, *return_painted; // the lowest cells painted
+
+Cell *stack_touched(Cell *bottom, Cell *top) {
+    // start of the lowest page between bottom and top that has memory behind
+    // it, or top if none have; bottom is page aligned
+    size_t pages = ((char *)top - (char *)bottom + page_size - 1) / page_size;
+    unsigned char *resident = malloc(pages);
+    Cell *lowest = bottom; // if we can't tell, assume all of it
+    if (resident && mincore(bottom, (char *)top - (char *)bottom, resident) == 0) {
+        size_t i = 0;
+        while (i < pages && !(resident[i] & 1)) i++;
+        lowest = i < pages ? (Cell *)((char *)bottom + i * page_size) : top;
     }
-    *out = '\0';
-    *input_ptr = in; // interesting... updates the pointer itself
-
-    return token;
+    free(resident);
+    return lowest;
 }
 
-// TODO I think if we finish converting JonesForth then
-// interpret will run in Forth when you initially run QUIT
-// instead of having this C function (TBD)
-// Converted this function to use WORD and work like it does in JonesForth
-// TODO make this a word as well (INTERPRET)
+Cell *stack_paint_from(Cell *bottom, Cell *top) {
+    // where stats_paint starts painting a stack
+    Cell *p = stack_touched(bottom, top);
+    size_t window = STACK_PAINT_PAGES * page_size / sizeof(Cell);
+    p = (size_t)(p - bottom) > window ? p - window : bottom;
+    return (Cell *)((uintptr_t)p & ~(uintptr_t)(page_size - 1));
+}
 
-int words_remain(void) {
-    // determine if there are any words left in the input_buffer
-    // to prevent do_interpret from trying to get more words unnecessarily
+void stats_paint(void) {
+    data_painted = stack_paint_from(data_stack, sp);
+    return_painted = stack_paint_from(return_stack, rp);
+    for (Cell *p = data_painted; p < sp; p++) *p = STACK_PAINT;
+    for (Cell *p = return_painted; p < rp; p++) *p = STACK_PAINT;
+}
 
-    int offset = currkey;
-    while (offset < bufftop) {
-        if (!isspace(input_buffer[offset])) {
-            return(1);
-        }
-        offset++;
+Cell stack_max_depth(Cell *bottom, Cell *top, Cell *painted) {
+    // stacks grow down from top, bottom is as far as they can go
+    Cell *p = stack_touched(bottom, top);
+    if (p < painted) {
+        return top - p; // went below what was painted
     }
-    return(0);
+    p = painted;
+    while (p < top && *p == STACK_PAINT) p++;
+    return top - p;
 }
 
-void do_interpret(void) {
-    while (words_remain()) {
-        do_word();
-        do_find();
-        Word *w = (Word *)pop();
-        if (w) {
-            if ((w->flags & F_IMMED) || state == 0) {
-                // run it now
-                if (w->code == docol) {
-                    run(w);
-                } else {
-                    current_word = w;
-                    w->code();
-                }
-            } else {
-                push((Cell)w);
-                do_comma();
-            }
-        } else {
-            // Not found — try to parse number
-            push((Cell)word_buffer);
-            push(strlen(word_buffer));
-            do_number();
-            int unparsed = pop();
-            int number = pop();
-            if (unparsed == 0) {
-                if (state == 0) {
-                    push(number);
-                } else {
-                    push((Cell)&word_lit);
-                    do_comma();
-                    push(number);
-                    do_comma();
-                }
-            } else {
-                printf("Unknown word: %s\n", word_buffer);
-            }
-        }
+void stats_json(FILE *f) {
+    fprintf(f, "{\n");
+#if STATS >= 2
+    fprintf(f, "  \"dispatched\": %llu,\n", (unsigned long long)stats.dispatched);
+#endif
+    fprintf(f, "  \"docol\": %llu,\n", (unsigned long long)stats.docol);
+    fprintf(f, "  \"find_calls\": %llu,\n", (unsigned long long)stats.find_calls);
+    fprintf(f, "  \"find_misses\": %llu,\n", (unsigned long long)stats.find_misses);
+    fprintf(f, "  \"numbers\": %llu,\n", (unsigned long long)stats.numbers);
+    fprintf(f, "  \"data_stack_max\": %ld,\n", (long)stack_max_depth(data_stack, s0, data_painted));
+    fprintf(f, "  \"data_stack_size\": %zu,\n", data_stack_size);
+    fprintf(f, "  \"return_stack_max\": %ld,\n", (long)stack_max_depth(return_stack, r0, return_painted));
+    fprintf(f, "  \"return_stack_size\": %zu,\n", return_stack_size);
+    fprintf(f, "  \"dictionary_used\": %ld,\n", (long)((char *)here - dictionary));
+    fprintf(f, "  \"dictionary_size\": %zu,\n", dictionary_size);
+    fprintf(f, "  \"data_space_used\": %ld,\n", (long)((char *)data_here - data_space));
+    fprintf(f, "  \"data_space_size\": %zu\n", data_space_size);
+    fprintf(f, "}\n");
+}
+
+void do_stats(void) {
+    // STATS, print the counters
+#if STATS >= 2
+    output_printf("dispatched       %llu\n", (unsigned long long)stats.dispatched);
+#endif
+    output_printf("docol            %llu\n", (unsigned long long)stats.docol);
+    output_printf("FIND             %llu calls, %llu misses\n",
+           (unsigned long long)stats.find_calls, (unsigned long long)stats.find_misses);
+    output_printf("numbers parsed   %llu\n", (unsigned long long)stats.numbers);
+    output_printf("data stack       %ld of %zu cells\n", (long)stack_max_depth(data_stack, s0, data_painted), data_stack_size);
+    output_printf("return stack     %ld of %zu cells\n", (long)stack_max_depth(return_stack, r0, return_painted), return_stack_size);
+    output_printf("dictionary       %ld of %zu bytes\n", (long)((char *)here - dictionary), dictionary_size);
+    output_printf("data space       %ld of %zu bytes\n", (long)((char *)data_here - data_space), data_space_size);
+}
+
+Word word_stats = { NULL, 0, "STATS", do_stats, NULL };
+
+void stats_at_exit(void) {
+    // RIVERSFORTH_STATS=file (- for stderr) writes the counters there as JSON;
+    // from atexit since input can run out inside get_key(), which exits there
+    const char *path = getenv("RIVERSFORTH_STATS");
+    if (path == NULL) {
+        return;
+    }
+    FILE *f = strcmp(path, "-") == 0 ? stderr : fopen(path, "w");
+    if (f == NULL) {
+        perror(path);
+        return;
+    }
+    stats_json(f);
+    if (f != stderr) {
+        fclose(f);
     }
 }
+#endif
 
-void interpret(char *s) {
-    strncpy(input_buffer, s, INPUT_BUFFER_SIZE);
-    currkey = 0;
-    bufftop = strlen(input_buffer);
-    do_interpret();
+void usage(const char *name) {
+    fprintf(stderr, "usage: %s [--data-stack cells] [--return-stack cells] [--dictionary bytes]\n"
+                    "       [--data-space bytes] [--huge-pages] [--image file]\n"
+                    "       [--fork-server socket] [file ...]\n", name);
+    exit(1);
 }
 
-int main(void)
+// the rest of the command line, used after startup
+const char *server_path = NULL; // --fork-server
+const char **source_files;
+int nsource_files = 0;
+
+int main(int argc, char **argv)
 {
+    source_files = calloc(argc, sizeof(char *));
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--data-stack") == 0 && i + 1 < argc) {
+            data_stack_size = strtoul(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--return-stack") == 0 && i + 1 < argc) {
+            return_stack_size = strtoul(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--dictionary") == 0 && i + 1 < argc) {
+            dictionary_size = strtoul(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--data-space") == 0 && i + 1 < argc) {
+            data_space_size = strtoul(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--huge-pages") == 0) {
+            huge_pages = 1;
+        } else if (strcmp(argv[i], "--image") == 0 && i + 1 < argc) {
+            image_file = argv[++i];
+        } else if (strcmp(argv[i], "--fork-server") == 0 && i + 1 < argc) {
+            server_path = argv[++i];
+        } else if (argv[i][0] == '-') {
+            usage(argv[0]);
+        } else {
+            source_files[nsource_files++] = argv[i];
+        }
+    }
+    if (data_stack_size == 0 || return_stack_size == 0 || dictionary_size == 0 || data_space_size == 0) {
+        usage(argv[0]);
+    }
+    atexit(output_flush);
+    stacks_init();
+    dictionary_init();
+    cells_init();
+#if DEBUG
+    // where the words the tests below define start, to forget them afterwards
+    void *test_here = here;
+    char *test_data = data_here;
+#endif
     s0 = sp; // initial value of sp. We must assign in main (or any function) because it's not a constant
     r0 = rp; // initial value of rp. ditto.
+#if STATS
+    stats_paint();
+    atexit(stats_at_exit);
+#endif
+#if SAMPLER
+    sample_start();
+#endif
 
     // DOT at the top so we can use it in unit tests
     // but I think it will also get converted to native Forth once we get to that point
     add_word(&word_dot); 
-    // no test for dot
+    add_word(&word_udot);
+    add_word(&word_dotr);
+    add_word(&word_udotr);
+    add_word(&word_less_sharp);
+    add_word(&word_sharp);
+    add_word(&word_sharp_s);
+    add_word(&word_hold);
+    add_word(&word_sign);
+    add_word(&word_sharp_greater);
+#if DEBUG
+    // no test for dot itself, but for how it writes numbers
+    char number_test[NUMBER_SIZE];
+    assert(format_number(number_test, 0, 10) == 1 && strcmp(number_test, "0") == 0);
+    assert(format_number(number_test, -255, 16) == 3 && strcmp(number_test, "-FF") == 0);
+    assert(format_number(number_test, INTPTR_MIN, 10) == 20 && strcmp(number_test, "-9223372036854775808") == 0);
+    assert(format_number(number_test, INTPTR_MIN, 2) == 65);
+    assert(format_number(number_test, 35, 36) == 1 && strcmp(number_test, "Z") == 0);
+    // and a picture of -1234 as "-12.34", then all 64 bits of -1 in base 2
+    push(-1234);
+    push(1234);
+    do_less_sharp();
+    do_sharp();
+    do_sharp();
+    push('.');
+    do_hold();
+    do_sharp_s();
+    assert(sp[0] == 0);
+    sp[0] = sp[1];
+    sp[1] = 0;
+    do_sign();
+    do_sharp_greater();
+    assert(sp[0] == 6 && memcmp((char *)sp[1], "-12.34", 6) == 0);
+    sp += 2;
+    base = 2;
+    push(-1);
+    do_less_sharp();
+    do_sharp_s();
+    do_sharp_greater();
+    assert(sp[0] == 64 && ((char *)sp[1])[63] == '1');
+    sp += 2;
+    base = 10;
+#endif
 
     add_word(&word_drop);
 #if DEBUG
@@ -1415,6 +5461,150 @@ int main(void)
     assert(strcmp("ABCDEfghi",testbuff2) == 0);
     assert(save == sp);
 #endif
+    add_word(&word_cmove_up);
+    add_word(&word_move);
+    add_word(&word_fill);
+    add_word(&word_erase);
+    add_word(&word_move_cells);
+    add_word(&word_fill_cells);
+    add_word(&word_compare);
+    add_word(&word_search);
+#if DEBUG
+    {
+        // overlapping both ways: CMOVE and CMOVE> repeat, MOVE doesn't
+        char overlap[12];
+        strcpy(overlap, "abcdefghijk");
+        push((Cell)overlap); push((Cell)overlap + 3); push(8);
+        interpret("CMOVE ");
+        assert(strcmp(overlap, "abcabcabcab") == 0);
+        strcpy(overlap, "abcdefghijk");
+        push((Cell)overlap + 3); push((Cell)overlap); push(8);
+        interpret("CMOVE> ");
+        assert(strcmp(overlap, "jkijkijkijk") == 0);
+        strcpy(overlap, "abcdefghijk");
+        push((Cell)overlap); push((Cell)overlap + 3); push(8);
+        interpret("MOVE ");
+        assert(strcmp(overlap, "abcabcdefgh") == 0);
+        push((Cell)overlap + 1); push(3); push('x');
+        interpret("FILL ");
+        assert(strcmp(overlap, "axxxbcdefgh") == 0);
+        push((Cell)overlap + 10); push(1);
+        interpret("ERASE ");
+        assert(strcmp(overlap, "axxxbcdefg") == 0);
+        Cell cells[4] = { 1, 2, 3, 4 };
+        push((Cell)cells); push((Cell)(cells + 1)); push(3);
+        interpret("MOVE-CELLS ");
+        push((Cell)cells); push(1); push(-5);
+        interpret("FILL-CELLS ");
+        assert(cells[0] == -5 && cells[1] == 1 && cells[3] == 3);
+        push((Cell)"abc"); push(3); push((Cell)"abd"); push(3);
+        push((Cell)"abc"); push(3); push((Cell)"ab"); push(2);
+        push((Cell)"ab"); push(2); push((Cell)"ab"); push(2);
+        push((Cell)"\xFF"); push(1); push((Cell)"a"); push(1);
+        interpret("COMPARE ");
+        assert(pop() == 1);
+        interpret("COMPARE ");
+        assert(pop() == 0);
+        interpret("COMPARE ");
+        assert(pop() == 1);
+        interpret("COMPARE ");
+        assert(pop() == -1);
+        const char *haystack = "abababcab";
+        push((Cell)haystack); push(9); push((Cell)"abc"); push(3);
+        interpret("SEARCH ");
+        assert(pop() == 1 && pop() == 5 && pop() == (Cell)haystack + 4);
+        push((Cell)haystack); push(9); push((Cell)"abd"); push(3);
+        interpret("SEARCH ");
+        assert(pop() == 0 && pop() == 9 && pop() == (Cell)haystack);
+        assert(save == sp);
+    }
+#endif
+    add_word(&word_vadd);
+    add_word(&word_vsub);
+    add_word(&word_vmul);
+    add_word(&word_vand);
+    add_word(&word_vor);
+    add_word(&word_vxor);
+    add_word(&word_vadds);
+    add_word(&word_vsubs);
+    add_word(&word_vmuls);
+    add_word(&word_vands);
+    add_word(&word_vors);
+    add_word(&word_vxors);
+    add_word(&word_veq);
+    add_word(&word_vlt);
+    add_word(&word_vgt);
+    add_word(&word_vsum);
+    add_word(&word_vmin);
+    add_word(&word_vmax);
+    add_word(&word_vdot);
+    add_word(&word_vscan);
+#if DEBUG
+    {
+        Cell a[11], b[11], dst[11], expect[11];
+        for (int i = 0; i < 11; i++) {
+            a[i] = (i - 5) * 0x100000001;
+            b[i] = i % 3 == 0 ? a[i] : 7 - i;
+        }
+        push((Cell)a); push((Cell)b); push((Cell)dst); push(11);
+        interpret("V* ");
+        for (int i = 0; i < 11; i++) assert(dst[i] == V_MUL_1(a[i], b[i]));
+        push((Cell)a); push(-3); push((Cell)dst); push(11);
+        interpret("V+S ");
+        assert(dst[0] == a[0] - 3 && dst[10] == a[10] - 3);
+        push((Cell)a); push((Cell)b); push((Cell)dst); push(11);
+        interpret("V< ");
+        assert(dst[0] == 0 && dst[1] == -1 && dst[6] == 0 && dst[10] == 0);
+        push((Cell)a); push(11);
+        push((Cell)a); push(11);
+        push((Cell)a); push(11);
+        push((Cell)a); push((Cell)a); push(11);
+        interpret("VDOT ");
+        assert(pop() == cells_dot_scalar(a, a, 11));
+        interpret("VMAX ");
+        assert(pop() == a[10]);
+        interpret("VMIN ");
+        assert(pop() == a[0]);
+        interpret("VSUM ");
+        assert(pop() == 0);
+        push((Cell)b); push((Cell)dst); push(11);
+        interpret("VSCAN ");
+        assert(dst[0] == b[0] && dst[10] == cells_sum_scalar(b, 11));
+        assert(save == sp);
+#if defined(__x86_64__) && defined(__GNUC__)
+        // the AVX2 kernels against the C ones, for every length up to 11
+        if (__builtin_cpu_supports("avx2")) {
+            CellsBinary avx2[V_OPS] = {
+                cells_V_ADD_avx2, cells_V_SUB_avx2, cells_V_MUL_avx2,
+                cells_V_AND_avx2, cells_V_OR_avx2,  cells_V_XOR_avx2,
+                cells_V_EQ_avx2,  cells_V_LT_avx2,  cells_V_GT_avx2,
+            };
+            CellsBinary scalar[V_OPS] = {
+                cells_V_ADD_scalar, cells_V_SUB_scalar, cells_V_MUL_scalar,
+                cells_V_AND_scalar, cells_V_OR_scalar,  cells_V_XOR_scalar,
+                cells_V_EQ_scalar,  cells_V_LT_scalar,  cells_V_GT_scalar,
+            };
+            for (size_t n = 0; n <= 11; n++) {
+                for (int op = 0; op < V_OPS; op++) {
+                    avx2[op](dst, a, b, 0, n);
+                    scalar[op](expect, a, b, 0, n);
+                    assert(memcmp(dst, expect, n * sizeof(Cell)) == 0);
+                    avx2[op](dst, a, NULL, -2, n);
+                    scalar[op](expect, a, NULL, -2, n);
+                    assert(memcmp(dst, expect, n * sizeof(Cell)) == 0);
+                }
+                assert(cells_sum_avx2(a, n) == cells_sum_scalar(a, n));
+                assert(cells_min_avx2(b, n) == cells_min_scalar(b, n));
+                assert(cells_max_avx2(a, n) == cells_max_scalar(a, n));
+                assert(cells_dot_avx2(a, b, n) == cells_dot_scalar(a, b, n));
+                cells_scan_avx2(dst, a, n, 5);
+                cells_scan_scalar(expect, a, n, 5);
+                assert(memcmp(dst, expect, n * sizeof(Cell)) == 0);
+            }
+        }
+#endif
+    }
+#endif
 
 
     add_word(&word_exit);
@@ -1466,6 +5656,8 @@ int main(void)
     add_word(&word_do_con_docol);
     add_word(&word_do_con_f_immed);
     add_word(&word_do_con_f_hidden);
+    add_word(&word_do_con_f_inline);
+    add_word(&word_do_con_f_noinline);
 #if DEBUG
     interpret("VERSION R0 DOCOL F_IMMED F_HIDDEN ");
     assert(pop() == 2);
@@ -1509,11 +5701,91 @@ int main(void)
 
     add_word(&word_key);
     add_word(&word_emit);
+    add_word(&word_tell);
     add_word(&word_word); // lol
-    // tested interactively
+#if DEBUG
+    // whitespace (or not) at every offset, in and after the 32, 16 and 8 byte
+    // blocks, with bytes over 127 being part of words
+    char scan_test[80];
+    for (size_t n = 0; n <= sizeof(scan_test); n++) {
+        for (size_t k = 0; k <= n; k++) {
+            memset(scan_test, '\xE9', n);
+            if (k < n) scan_test[k] = '\t';
+            assert(scan_bytes(scan_test, n, 1) == k);
+#if SCAN_SWAR
+            assert(scan_bytes_swar(scan_test, n, 1) == k);
+#endif
+            memset(scan_test, ' ', n);
+            if (k < n) scan_test[k] = k % 2 ? '!' : '\xE9';
+            assert(scan_bytes(scan_test, n, 0) == k);
+#if SCAN_SWAR
+            assert(scan_bytes_swar(scan_test, n, 0) == k);
+#endif
+        }
+    }
+    // no limit on the length of a word any more
+    interpret("WORD \\ \n  a_word_that_is_quite_a_bit_longer_than_the_sixty_four_bytes_there_used_to_be ");
+    assert(pop() == 76);
+    assert(strncmp((char *)pop(), "a_word_that", 11) == 0);
+    assert(save == sp);
+#endif
 
     add_word(&word_number);
-    // TODO add automated testing after interpret etc is converted to use WORD/KEY/NUMBER
+    add_word(&word_parse_numbers);
+#if DEBUG
+    // the whole cell, in and out of the eight digit chunks, and other bases
+    interpret("9223372036854775807 -9223372036854775808 12345678 -123456789 ");
+    assert(pop() == -123456789);
+    assert(pop() == 12345678);
+    assert(pop() == INTPTR_MIN);
+    assert(pop() == INTPTR_MAX);
+    interpret("16 BASE ! 7fffFFFF12 -A A BASE ! 2 BASE ! 101 1010 BASE ! ");
+    assert(pop() == 5);
+    assert(pop() == -10);
+    assert(pop() == 0x7fffffff12);
+    push((Cell)"1234567x9");
+    push(9);
+    do_number();
+    assert(pop() == 2); // unparsed
+    assert(pop() == 1234567);
+    push((Cell)"-");
+    push(1);
+    do_number();
+    assert(pop() == 1);
+    assert(pop() == 0);
+    Cell parsed[5] = { 0, 0, 0, 0, 42 };
+    push((Cell)"  1 22\n-333 123456789012  x 5");
+    push(29);
+    push((Cell)parsed);
+    do_parse_numbers();
+    assert(pop() == 4);
+    assert(parsed[0] == 1 && parsed[1] == 22 && parsed[2] == -333 && parsed[3] == 123456789012);
+    assert(parsed[4] == 42); // nothing for the x
+    assert(save == sp);
+#if defined(__GNUC__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    // every byte at every place in an eight hex digit chunk, against the table
+    for (int at = 0; at < 8; at++) {
+        for (int c = 0; c < 256; c++) {
+            char hex[9] = "9aF0b1E2";
+            hex[at] = c;
+            uint64_t chunk;
+            memcpy(&chunk, hex, 8);
+            int valid = digit_value[c] < 16;
+            assert(eight_hex_digits(chunk) == valid);
+            if (valid) {
+                uint64_t expect = 0;
+                for (int i = 0; i < 8; i++) expect = expect << 4 | digit_value[(unsigned char)hex[i]];
+                assert(eight_hex_digits_value(chunk) == expect);
+            }
+        }
+    }
+#endif
+    interpret("16 BASE ! DeadBeefCafe1234 -fFfF00001 0123456789abcdeF A BASE ! ");
+    assert(pop() == 0x0123456789abcdef);
+    assert(pop() == -0xfFfF00001);
+    assert(pop() == (Cell)0xDeadBeefCafe1234);
+    assert(save == sp);
+#endif
 
     // compiling words
     add_word(&word_find);
@@ -1544,22 +5816,538 @@ int main(void)
     add_word(&word_lbrac);
     add_word(&word_rbrac);
     add_word(&word_immediate);
+    add_word(&word_inline);
+    add_word(&word_noinline);
     add_word(&word_hidden);
     add_word(&word_hide);
     add_word(&word_colon);
     add_word(&word_semicolon);
     add_word(&word_tick);
-    // TODO add automated tests
+    add_word(&word_allot);
+    add_word(&word_variable);
+#if DEBUG
+    // VARIABLEs and ALLOT come out of the data space, colon words' bodies out
+    // of the dictionary, starting on a cache line
+    interpret("VARIABLE vt 42 vt ! : vt2 vt @ 1+ ; vt2 ");
+    assert(pop() == 43);
+    assert((char *)find("vt")->params >= data_space && (char *)find("vt")->params < (char *)data_here);
+    assert(((uintptr_t)find("vt2")->params & (BODY_ALIGN - 1)) == 0);
+    interpret("3 ALLOT 8 ALLOT SWAP - ");
+    assert(pop() == 8); // cell aligned
+    assert(save == sp);
+
+    // newer definitions shadow older ones, in any case, and hidden ones are skipped
+    interpret(": hashtest 1 ; : HashTest 2 ; ");
+    assert(save == sp);
+    interpret("hashtest ");
+    assert(pop() == 2);
+    interpret("hide HASHTEST hashtest ");
+    assert(pop() == 1);
+    assert(find("hashtest") == latest);
+    assert(find("hashtest")->flags & F_HIDDEN);
+    interpret("latest @ hidden ");
+    assert(save == sp);
+    push((Cell)"hashtest");
+    push(8);
+    do_find();
+    assert(pop() == (Cell)latest);
+    push((Cell)"hashtest?");
+    push(8); // only the first 8 characters count
+    do_find();
+    assert(pop() == (Cell)latest);
+    push((Cell)"hashtes");
+    push(7);
+    do_find();
+    assert(pop() == 0);
+    assert(save == sp);
+#endif
+
+#if DEBUG && INLINE_LIMIT >= 2 && INLINE_LIMIT < 10
+    // short colon words get copied in instead of called
+    // (calls in the tests are followed by something so they don't become TAILCALLs)
+    interpret(": sq dup * ; : cube dup sq * ; ");
+    Cell *inl_body = (Cell *)latest->params;
+    assert(inl_body[0] == (Cell)&word_dup && inl_body[1] == (Cell)&word_dup);
+    assert(inl_body[2] == (Cell)&word_mul && inl_body[3] == (Cell)&word_mul);
+    interpret("3 cube ");
+    assert(pop() == 27);
+    interpret(": oct quadruple double ; ");
+    inl_body = (Cell *)latest->params;
+    assert(inl_body[0] != (Cell)&word_quadruple && inl_body[0] != (Cell)&word_double);
+    interpret("1 oct ");
+    assert(pop() == 8);
+
+    // ... unless they use the return stack, or are marked NOINLINE
+    interpret(": rsq >R R> dup * ; ");
+    interpret(": usesq rsq 1+ ; ");
+    assert(((Cell *)latest->params)[0] == (Cell)find("rsq"));
+    interpret(": nosq dup * ; NOINLINE : usenosq nosq 1+ ; ");
+    assert(((Cell *)latest->params)[0] == (Cell)find("nosq"));
+
+    // INLINE forces it for bigger words
+    interpret(": big 1 + 2 + 3 + 4 + 5 + ; : usebig big 1+ ; ");
+    assert(((Cell *)latest->params)[0] == (Cell)find("big"));
+    interpret(": big2 1 + 2 + 3 + 4 + 5 + ; INLINE : usebig2 big2 1+ ; ");
+    assert(((Cell *)latest->params)[0] != (Cell)find("big2"));
+    interpret("0 usebig 0 usebig2 ");
+    assert(pop() == 16);
+    assert(pop() == 16);
+    assert(save == sp);
+#endif
 
     add_word(&word_branch);
     add_word(&word_zbranch);
+    add_word(&word_triangle);
+#if DEBUG
+    interpret("10 triangle ");
+    assert(pop() == 55);
+    assert(save == sp);
+    assert(save_rp == rp);
+
+    interpret("0 triangle 1 triangle ");
+    assert(pop() == 1);
+    assert(pop() == 0);
+    assert(save == sp);
+#endif
+
+    add_word(&word_optimize);
+#if DEBUG && PEEPHOLE
+    interpret(": pp1 DUP + 5 + 3 = ; ");
+    Cell *pp_body = (Cell *)latest->params;
+    assert(pp_body[0] == (Cell)&word_dupadd);
+    assert(pp_body[1] == (Cell)&word_litadd && pp_body[2] == 5);
+    assert(pp_body[3] == (Cell)&word_litequ && pp_body[4] == 3);
+    assert(pp_body[5] == (Cell)&word_exit);
+    assert((Cell *)here == pp_body + 6);
+    interpret("-1 pp1 0 pp1 ");
+    assert(pop() == 0);
+    assert(pop() == 1);
+    assert(save == sp);
+
+    // ( n -- 2n+2(n-1)+...+2 ), a loop whose branches need fixing up
+    push((Cell)"pp2");
+    push(3);
+    do_create();
+    Cell pp2_body[] = {
+        (Cell)&word_lit, 0, (Cell)&word_swap,
+        (Cell)&word_dup, (Cell)&word_lit, 0, (Cell)&word_gt, (Cell)&word_zbranch, 12,
+        (Cell)&word_dup, (Cell)&word_dup, (Cell)&word_add, (Cell)&word_rot, (Cell)&word_add,
+        (Cell)&word_swap, (Cell)&word_lit, -1, (Cell)&word_add, (Cell)&word_branch, -16,
+        (Cell)&word_drop, (Cell)&word_exit
+    };
+    for (size_t i = 0; i < sizeof(pp2_body) / sizeof(Cell); i++) {
+        push(pp2_body[i]);
+        do_comma();
+    }
+    do_optimize();
+    pp_body = (Cell *)latest->params;
+    assert((Cell *)here - pp_body == 19);
+    assert(pp_body[6] == (Cell)&word_gt_zbranch);
+    assert(pp_body[9] == (Cell)&word_dupadd);
+    interpret("4 pp2 0 pp2 ");
+    assert(pop() == 0);
+    assert(pop() == 20);
+    assert(save == sp);
+#endif
+
+#if DEBUG
+    // JonesForth's IF THEN and RECURSE, adjusted for cell sized branch offsets
+    interpret(": RECURSE IMMEDIATE LATEST @ , ; ");
+    interpret(": IF IMMEDIATE ' 0BRANCH , HERE @ 0 , ; ");
+    interpret(": THEN IMMEDIATE DUP HERE @ SWAP - 8 / SWAP ! ; ");
+    assert(save == sp);
+
+    // counting down from 10000 would run the return stack over without tail calls
+    interpret(": countdown DUP IF 1- RECURSE THEN ; ");
+#if TAIL_CALLS
+    Cell *tc_body = (Cell *)latest->params;
+    assert(tc_body[4] == (Cell)&word_tailcall && tc_body[5] == (Cell)latest);
+    assert(tc_body[6] == (Cell)&word_exit);
+    interpret("10000 countdown ");
+#else
+    interpret("50 countdown ");
+#endif
+    assert(pop() == 0);
+    assert(save == sp);
+    assert(save_rp == rp);
+#if !PROFILE // which would lose track of how deep it is
+    // but not to (or by inlining) a word that drops its caller's return
+    // address, which would drop the wrong one
+    interpret(": bail R> DROP ; : outer 1 bail ; : top outer 99 ; top ");
+    assert(pop() == 99);
+    assert(pop() == 1);
+    assert(save == sp);
+    assert(save_rp == rp);
+#endif
+#endif
+
+#if DEBUG && CONST_FOLD
+    // literal arithmetic is done while compiling
+    interpret(": cf1 2 3 + 4 * 1- INVERT ; ");
+    Cell *cf_body = (Cell *)latest->params;
+    assert(cf_body[0] == (Cell)&word_lit && cf_body[1] == ~19);
+    assert(cf_body[2] == (Cell)&word_exit);
+    interpret(": cf5 1 2 3 + + ; "); // right nested, the 1 waits under the 2 3 +
+    cf_body = (Cell *)latest->params;
+    assert(cf_body[0] == (Cell)&word_lit && cf_body[1] == 6);
+    assert(cf_body[2] == (Cell)&word_exit);
+    interpret(": cf2 DUP 2 3 * - ; ");
+    cf_body = (Cell *)latest->params;
+    assert(cf_body[1] == (Cell)&word_lit && cf_body[2] == 6);
+    interpret("10 cf2 ");
+    assert(pop() == 4);
+    assert(pop() == 10);
+    // division by zero is left for run time
+    interpret(": cf3 1 0 / ; ");
+    cf_body = (Cell *)latest->params;
+    assert(cf_body[4] == (Cell)&word_div);
+    // and nothing is folded into a literal that a branch lands after
+    interpret(": cf4 DUP IF 1 + THEN 2 + ; ");
+    interpret("5 cf4 0 cf4 ");
+    assert(pop() == 2);
+    assert(pop() == 8);
+    assert(save == sp);
+#endif
+
+#if DEBUG && JIT
+    // colon words become machine code, calling themselves and each other directly
+    interpret(": fib DUP 2 < IF EXIT THEN DUP 1- RECURSE SWAP 2 - RECURSE + ; ");
+    assert(jit_owns(latest->code) && (latest->flags & F_JIT));
+    interpret("20 fib ");
+    assert(pop() == 6765);
+    // triangle is threaded, so it's run by run() from inside native code
+    interpret(": jt1 >R 12 triangle R> + ; ");
+    assert(jit_owns(latest->code));
+    interpret("100 jt1 ");
+    assert(pop() == 178);
+    interpret(": jt2 fib jt1 HERE C@ DROP ; ");
+    interpret("10 jt2 ");
+    assert(pop() == 133);
+    // words that play with the return stack stay threaded
+    interpret(": jt3 RSP@ DROP ; ");
+    assert(latest->code == docol);
+    // and so do words with data , into them
+    interpret(": jt4 BRANCH [ 2 , 12345 , ] 7 ; jt4 ");
+    assert(latest->code == docol);
+    assert(pop() == 7);
+    assert(save == sp);
+    assert(save_rp == rp);
+#endif
+
+    add_word(&word_save_c);
+#if DEBUG
+    // everything defined so far that isn't playing with the return stack
+    interpret(": aot1 RSP@ DROP ; : aot2 aot1 ; : aot3 DUP IF 1- THEN 2 * ; ");
+    FILE *aot_out = tmpfile();
+    int aot_count = save_c(aot_out);
+    char aot_text[4096];
+    assert(aot_count > 0);
+    rewind(aot_out);
+    int aot_seen = 0;
+    while (fgets(aot_text, sizeof(aot_text), aot_out)) {
+        assert(strstr(aot_text, "\"aot1\"") == NULL && strstr(aot_text, "\"aot2\"") == NULL);
+        aot_seen += strstr(aot_text, "\"aot3\"") != NULL;
+    }
+    assert(aot_seen == 1);
+    fclose(aot_out);
+    assert(save == sp);
+#endif
+
+    add_word(&word_save_image);
+#if DEBUG
+    // save a few words, forget them and load them back a page further on, so
+    // everything in them has to be relocated
+    image_base_latest = latest;
+    image_base_here = here;
+    image_base_data = data_here;
+    interpret("VARIABLE iv 5 iv ! : it1 iv @ 1+ ; : it2 it1 DUP + ; VARIABLE ix LATEST @ ix ! ");
+    char image_name[] = "/tmp/riversforth-image-XXXXXX";
+    int image_fd = mkstemp(image_name);
+    assert(image_fd >= 0);
+    FILE *image_out = fdopen(image_fd, "wb");
+    assert(save_image(image_out) == 4);
+    fclose(image_out);
+    Word *it2 = find("it2");
+    latest = image_base_latest;
+    here = image_base_here + 1; // so "the page after here" isn't where they were, even if here was page aligned
+    data_here = image_base_data;
+    assert(find("it2") == NULL);
+    assert(load_image(image_name) == NULL);
+    assert(find("it2") != NULL && find("it2") != it2);
+    interpret("it2 ix @ ");
+    assert(pop() == (Cell)find("ix"));
+    assert(pop() == 12);
+    assert(save == sp);
+    // and forget them again, so the dictionary has no gap where the first
+    // copies were
+    latest = image_base_latest;
+    here = image_base_here;
+    data_here = image_base_data;
+    assert(find("it2") == NULL);
+    // a broken image is turned away before anything gets written
+    ImageHeader image_h;
+    image_fd = open(image_name, O_RDWR);
+    assert(pread(image_fd, &image_h, sizeof(image_h), 0) == sizeof(image_h));
+    uint64_t image_bad = (uint64_t)1 << 40 | IMAGE_ARENA; // a dictionary offset a long way out
+    assert(pwrite(image_fd, &image_bad, sizeof(image_bad), image_h.relocs_offset) == sizeof(image_bad));
+    assert(strcmp(load_image(image_name), "image is corrupt") == 0);
+    assert(ftruncate(image_fd, image_h.relocs_offset) == 0);
+    assert(strcmp(load_image(image_name), "image is corrupt") == 0);
+    close(image_fd);
+    unlink(image_name);
+    assert(latest == image_base_latest && here == image_base_here);
+#endif
+
+#if PROFILE
+    add_word(&word_profile_report);
+#endif
+#if DEBUG && PROFILE
+    // pfib runs 177 times for 10, and gets all the time its callees took, but
+    // only once however deep it recursed
+    interpret(": pfib DUP 2 < IF EXIT THEN DUP 1- RECURSE SWAP 2 - RECURSE + ; ");
+    uint64_t prof_start = prof_now();
+    interpret("10 pfib DROP ");
+    uint64_t prof_elapsed = prof_now() - prof_start;
+    Word *prof_fib = find("pfib");
+    assert(prof_fib->prof_count == 177);
+    assert(prof_fib->prof_self > 0 && prof_fib->prof_self < prof_fib->prof_total);
+    assert(prof_fib->prof_total <= prof_elapsed && prof_fib->prof_active == 0);
+    assert(word_dup.prof_count > 0 && word_dup.prof_self == word_dup.prof_total);
+    assert(prof_depth == 0);
+    assert(save == sp);
+#endif
+
+#if SAMPLER
+    add_word(&word_sample_dump);
+#endif
+#if DEBUG && SAMPLER
+    // a few made up samples, unless real ones are being taken (the handler
+    // would add its own to them)
+    if (!sample_running) {
+        interpret(": sm1 DUP DROP ; : sm2 sm1 sm1 ; ");
+        Word *sm1 = find("sm1"), *sm2 = find("sm2");
+        Cell not_a_body;
+        sample_sort_bodies();
+        assert(sample_word_at((Cell *)sm1->params) == sm1);
+        assert(sample_word_at((Cell *)sm2->params + 1) == sm2);
+        assert(sample_word_at(&not_a_body) == NULL);
+        assert(sample_word_at(NULL) == NULL);
+        for (int i = 0; i < 3; i++) {
+            // in DUP, called from sm1, called from sm2, twice; then in the interpreter
+            samples[i] = i < 2 ? (Sample){ &word_dup, (Cell *)sm1->params + 1, 1, { (Cell)((Cell *)sm2->params + 1) } }
+                               : (Sample){ NULL, NULL, 0, { 0 } };
+        }
+        sample_next = 3;
+        sample_collect();
+        assert(sample_next == 0 && sample_nstacks == 2);
+        assert(strcmp(sample_stacks[0].stack, "sm2;sm1;DUP") == 0 && sample_stacks[0].count == 2);
+        assert(strcmp(sample_stacks[1].stack, "[interpreter]") == 0 && sample_stacks[1].count == 1);
+        sample_clear();
+        // half full, the next colon word that runs adds them up
+        for (int i = 0; i < SAMPLE_COUNT / 2; i++) {
+            samples[i] = (Sample){ &word_dup, (Cell *)sm1->params + 1, 0, { 0 } };
+        }
+        sample_next = SAMPLE_COUNT / 2;
+        interpret("3 sm1 ");
+        assert(sample_next == 0 && sample_nstacks == 1);
+        assert(strcmp(sample_stacks[0].stack, "sm1;DUP") == 0 && sample_stacks[0].count == SAMPLE_COUNT / 2);
+        assert(pop() == 3);
+        sample_clear();
+        // enough different stacks for the hash table to grow a few times
+        char sample_name[16];
+        for (int i = 0; i < 2000; i++) {
+            snprintf(sample_name, sizeof(sample_name), "s%d", i % 1000);
+            sample_add(sample_name);
+        }
+        assert(sample_nstacks == 1000 && sample_table_size >= 2000);
+        for (size_t i = 0; i < sample_nstacks; i++) {
+            assert(sample_stacks[i].count == 2);
+        }
+        sample_clear();
+    }
+#endif
+#if STATS
+    add_word(&word_stats);
+#endif
+#if DEBUG && STATS
+    interpret(": st1 RSP@ DROP DUP DUP DUP DROP DROP DROP ; "); // RSP@ keeps it threaded under JIT
+    uint64_t stats_docol = stats.docol, stats_misses = stats.find_misses;
+    interpret("7 st1 st1 DROP ");
+    assert(stats.docol == stats_docol + 2);
+    assert(stats.find_misses == stats_misses + 1); // 7
+    assert(stack_max_depth(data_stack, s0, data_painted) >= 4);
+    assert(save == sp);
+#endif
+
+#if DEBUG
+    // running off either end of a stack comes back here with the stacks reset
+    static sigjmp_buf error_test_jmp;
+    error_jmp = &error_test_jmp;
+    if (sigsetjmp(error_test_jmp, 1) == 0) {
+        interpret("DROP DROP . "); // DROP doesn't read the cell, . does
+        assert(0);
+    }
+    assert(strcmp(error_message, "data stack underflow") == 0);
+    assert(sp == s0 && rp == r0);
+#if !TOS_CACHE
+    // even by one cell, which the spare cell for TOS_CACHE would hide
+    if (sigsetjmp(error_test_jmp, 1) == 0) {
+        interpret(". ");
+        assert(0);
+    }
+    assert(strcmp(error_message, "data stack underflow") == 0);
+    assert(sp == s0 && rp == r0);
+#endif
+    if (sigsetjmp(error_test_jmp, 1) == 0) {
+        interpret(": sfill 1 RECURSE ; sfill ");
+        assert(0);
+    }
+    assert(strstr(error_message, "overflow") != NULL); // the return stack without tail calls
+    assert(sp == s0 && rp == r0 && state == 0);
+#if !JIT // JIT code recurses on the C stack instead
+    if (sigsetjmp(error_test_jmp, 1) == 0) {
+        interpret(": rdeep RECURSE 1 ; rdeep ");
+        assert(0);
+    }
+    assert(strcmp(error_message, "return stack overflow") == 0);
+    assert(sp == s0 && rp == r0);
+#endif
+    // running out of dictionary or data space is an error too
+    size_t real_dictionary_size = dictionary_size;
+    dictionary_size = (char *)here - dictionary + BODY_ALIGN;
+    if (sigsetjmp(error_test_jmp, 1) == 0) {
+        interpret(": dfull 1 2 3 4 5 6 7 8 9 ; ");
+        assert(0);
+    }
+    assert(strcmp(error_message, "dictionary full") == 0);
+    dictionary_size = real_dictionary_size;
+    if (sigsetjmp(error_test_jmp, 1) == 0) {
+        interpret("1073741824 ALLOT ");
+        assert(0);
+    }
+    assert(strcmp(error_message, "data space full") == 0);
+    assert(sp == s0 && rp == r0 && state == 0);
+    error_jmp = NULL;
+    assert(save == sp);
+    assert(save_rp == rp);
+
+    // the input layer, from a pipe into a 256 byte buffer: a line longer than
+    // 127 bytes, a word split between two read()s (the first one fills the
+    // buffer), and a last line without a newline, which refill() has to finish
+    int input_pipe[2];
+    assert(pipe(input_pipe) == 0);
+    char long_line[256] = "0";
+    for (int i = 0; i < 60; i++) strcat(long_line, " 1+");
+    while (strlen(long_line) < 250) strcat(long_line, " ");
+    assert(write(input_pipe[1], long_line, strlen(long_line)) == (ssize_t)strlen(long_line));
+    const char *more_input = "\n123456789 DUP\n7 KEY"; // 123456789 is at 251 to 259, KEY gets the added newline
+    assert(write(input_pipe[1], more_input, strlen(more_input)) == (ssize_t)strlen(more_input));
+    close(input_pipe[1]);
+    InputSource saved_input = input;
+    input = (InputSource){ malloc(256), 0, 0, 256, input_pipe[0], 0 };
+    interpret_all();
+    input_close(&input);
+    input = saved_input;
+    close(input_pipe[0]);
+    assert(pop() == '\n');
+    assert(pop() == 7);
+    assert(pop() == 123456789);
+    assert(pop() == 123456789);
+    assert(pop() == 60);
+    assert(sp == s0);
+
+    // a source file with a definition over several lines, then one that stops
+    // with an error, which has to say which file and make the exit status 1
+    char source_name[] = "/tmp/riversforth-source-XXXXXX";
+    int source_fd = mkstemp(source_name);
+    assert(source_fd >= 0);
+    const char *source = ": lf1 \\ ( a b -- c )\n    +\n    2 * ;\n3 4 lf1\n";
+    assert(write(source_fd, source, strlen(source)) == (ssize_t)strlen(source));
+    const char *source_files_test[] = { source_name };
+    assert(load_source_files(source_files_test, 1) == 0);
+    assert(pop() == 14);
+    assert(sp == s0 && error_jmp == NULL);
+    source = "1 2 + .\nWORD\n"; // and no word after it
+    assert(ftruncate(source_fd, 0) == 0);
+    assert(pwrite(source_fd, source, strlen(source), 0) == (ssize_t)strlen(source));
+    int source_pipe[2];
+    assert(pipe(source_pipe) == 0);
+    output_flush();
+    pid_t source_pid = fork();
+    assert(source_pid >= 0);
+    if (source_pid == 0) {
+        dup2(source_pipe[1], 2);
+        _exit(load_source_files(source_files_test, 1));
+    }
+    close(source_pipe[1]);
+    char source_error[256];
+    ssize_t source_error_length = read(source_pipe[0], source_error, sizeof(source_error) - 1);
+    assert(source_error_length > 0);
+    source_error[source_error_length] = '\0';
+    close(source_pipe[0]);
+    int source_status;
+    assert(waitpid(source_pid, &source_status, 0) == source_pid);
+    assert(WIFEXITED(source_status) && WEXITSTATUS(source_status) == 1);
+    assert(strncmp(source_error, source_name, strlen(source_name)) == 0);
+    assert(strcmp(source_error + strlen(source_name), ": unexpected end of input\n") == 0);
+    close(source_fd);
+    unlink(source_name);
+
+    // the tests' words (and what they ALLOTted) go again, so they don't
+    // ship in the dictionary, SAVE-C or images
+    forget_since(test_here, test_data);
+    for (Word *w = latest; w != NULL; w = w->link) {
+        assert(!in_dictionary(w));
+    }
+#if PROFILE
+    for (size_t i = 0; i < prof_nseen; i++) {
+        assert(!in_dictionary(prof_seen[i]));
+    }
+#endif
+    assert(find("IF") == NULL && find("countdown") == NULL && find("DUP") == &word_dup);
+#endif
+
+#ifdef AOT_FILE
+    // after the tests, which would shadow its words and then forget them
+    aot_register();
+#endif
 
-    char line[256];
+    // SAVE-IMAGE saves what gets defined from here on, which is where an
+    // --image goes as well
+    image_base_latest = latest;
+    image_base_here = here;
+    image_base_data = data_here;
+    if (image_file) {
+        const char *error = load_image(image_file);
+        if (error) {
+            fprintf(stderr, "%s: %s\n", image_file, error);
+            return 1;
+        }
+    }
+    if (load_source_files(source_files, nsource_files) != 0) {
+        return 1;
+    }
+    if (server_path) {
+        fork_server(server_path);
+    }
+
+#if STATS
+    stats_paint(); // again, so the tests above don't count
+#endif
+
+    input = input_from_fd(0);
+    static sigjmp_buf repl_jmp;
+    if (sigsetjmp(repl_jmp, 1)) {
+        output_printf("%s\n", error_message);
+        skip_line(); // throw away the rest of the line
+    }
+    error_jmp = &repl_jmp;
 
     while (1) {
-        printf("ok\n");
-        if (!fgets(line, sizeof(line), stdin)) break;
-        interpret(line);
+        output_bytes("ok\n", 3);
+        if (input.currkey >= input.bufftop && !refill()) break;
+        do_interpret();
+        skip_line();
     }
 
     return 0;